@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# MIMIKI - Compare regression benchmark reports (make bench)
+#
+# Each report is the JSON the launcher writes to /data/bench/<build>.json.
+# Prints one row per run and build, the first report given is the baseline
+# the others are compared against.
+import json
+import sys
+
+
+def run_key(run, result):
+    return (run["system"], run["rom"].rsplit("/", 1)[-1], result.get("preset", ""))
+
+
+# Frequency the run spent most of its time at, in MHz, and its share
+def top_freq(residency, per_mhz):
+    if not residency:
+        return "-"
+    freq, share = max(residency.items(), key=lambda item: item[1])
+    return "%d@%d%%" % (int(freq) // per_mhz, round(share * 100))
+
+
+def load(path):
+    with open(path) as fp:
+        report = json.load(fp)
+
+    rows = {}
+    for run in report["runs"]:
+        if not run.get("ok"):
+            continue
+        for result in run["results"]:
+            rows[run_key(run, result)] = {
+                "fps": result.get("steady_fps", result.get("fps")),
+                "avg": result.get("frame_ms_avg"),
+                "p99": result.get("frame_ms_p99"),
+                "cpu": top_freq(run.get("cpu_residency_khz"), 1000),
+                "gpu": top_freq(run.get("gpu_residency_hz"), 1000000),
+                "mwh": run.get("energy_mwh"),
+            }
+    return report["build"], rows
+
+
+def number(value, fmt):
+    return fmt % value if value is not None else "-"
+
+
+def delta(value, base):
+    if value is None or base is None or base == 0:
+        return ""
+    return "%+.1f%%" % ((value - base) * 100.0 / base)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("usage: bench-report.py BASELINE.json [REPORT.json...]", file=sys.stderr)
+        return 1
+
+    reports = [load(path) for path in sys.argv[1:]]
+    _, baseline = reports[0]
+    keys = sorted({key for _, rows in reports for key in rows})
+
+    print("%-4s %-28s %-9s %-20s %8s %8s %8s %8s %-10s %-10s %7s" %
+          ("sys", "rom", "preset", "build", "fps", "delta", "avg_ms", "p99_ms", "cpu_mhz", "gpu_mhz", "mWh"))
+    for key in keys:
+        base = baseline.get(key, {})
+        for build, rows in reports:
+            row = rows.get(key)
+            if not row:
+                continue
+            print("%-4s %-28.28s %-9s %-20.20s %8s %8s %8s %8s %-10s %-10s %7s" %
+                  (key[0], key[1], key[2], build, number(row["fps"], "%.1f"),
+                   delta(row["fps"], base.get("fps")), number(row["avg"], "%.2f"),
+                   number(row["p99"], "%.2f"), row["cpu"], row["gpu"], number(row["mwh"], "%.0f")))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -127,7 +127,13 @@ apply_patches() {
         if [ -f "$patch" ]; then
             local patch_name=$(basename "$patch")
             print_step "  Applying $patch_name..."
-            git apply "$patch"
+            # Optional patches only add diagnostics inside code upstream
+            # reworks often, a stale one must not stop the build
+            if [[ "$patch_name" == *.optional.patch ]]; then
+                git apply "$patch" || print_warning "  $patch_name does not apply, building without it"
+            else
+                git apply "$patch"
+            fi
         fi
     done
 
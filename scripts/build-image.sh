@@ -15,6 +15,9 @@ BOOTLOADER_DIR="$BUILD_DIR/boot"
 ROOTFS_SQUASHFS="$BUILD_DIR/rootfs.squashfs"
 OUTPUT_DIR="$BUILD_DIR/images"
 
+# Build tag for an instrumented boot (make bench-image), empty for a normal image
+BENCH_TAG="${MIMIKI_BENCH_TAG:-}"
+
 # Root size auto calculation (round up to next MiB)
 ROOTFS_SIZE=$(stat -c%s "$ROOTFS_SQUASHFS")
 
@@ -197,6 +200,13 @@ populate_boot_partition() {
     cp "$BUILD_DIR/boot/rk3566-miyoo-flip.dtb" "$mount_point/"
     cp "$BUILD_DIR/dt-overlays"/* "$mount_point/"
 
+    # Bench boots mark their stages through /dev/kmsg, which is rate limited by default
+    local bench_args=""
+    if [ -n "$BENCH_TAG" ]; then
+        print_step "Enabling instrumented boot, build tag '$BENCH_TAG'..."
+        bench_args=" mimiki.bench=$BENCH_TAG printk.devkmsg=on"
+    fi
+
     print_step "Creating EXTLINUX boot configuration..."
     mkdir -p "$mount_point/extlinux"
     cat > "$mount_point/extlinux/extlinux.conf" <<EOF
@@ -204,7 +214,7 @@ LABEL MIMIKI
   KERNEL /Image
   FDT /rk3566-miyoo-flip.dtb
   FDTOVERLAYS /rk3566-undervolt-cpu-l3.dtbo
-  APPEND rootwait quiet loglevel=0 fbcon=map:7
+  APPEND rootwait quiet loglevel=0 fbcon=map:7$bench_args
 EOF
 
     sync
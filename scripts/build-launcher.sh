@@ -39,6 +39,11 @@ check_dependencies() {
         missing_deps+=("${CROSS_COMPILE}gcc")
     fi
 
+    # Converts the font atlas at build time
+    if ! command -v python3 &> /dev/null; then
+        missing_deps+=("python3")
+    fi
+
     if [ ${#missing_deps[@]} -ne 0 ]; then
         print_error "Missing dependencies: ${missing_deps[*]}"
         exit 1
@@ -61,25 +66,11 @@ build_launcher() {
     print_step "Launcher built!"
 }
 
-install_launcher_assets() {
-    print_step "Installing launcher assets..."
-
-    mkdir -p "$SDL2_INSTALL/usr/share/mimiki/assets"
-
-    if [ -f "$LAUNCHER_DIR/assets/font.png" ]; then
-        cp "$LAUNCHER_DIR/assets/font.png" "$SDL2_INSTALL/usr/share/mimiki/assets/"
-        print_step "Font atlas installed!"
-    else
-        print_warning "Font atlas not found. Reggie what did you do."
-    fi
-}
-
 main() {
     print_step "MIMIKI Launcher Build"
 
     check_dependencies
     build_launcher
-    install_launcher_assets
 
     print_step "MIMIKI Launcher Build Complete!"
 }
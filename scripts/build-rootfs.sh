@@ -84,15 +84,6 @@ install_launcher() {
         print_warning "Launcher not built! Run 'make launcher' first."
     fi
 
-    local SDL2_INSTALL="$BUILD_DIR/sdl2-install"
-    if [ -d "$SDL2_INSTALL/usr/share/mimiki" ]; then
-        mkdir -p "$ROOTFS_BUILD/usr/share/mimiki"
-        cp -a "$SDL2_INSTALL/usr/share/mimiki"/* "$ROOTFS_BUILD/usr/share/mimiki/"
-        print_step "Launcher assets installed!"
-    else
-        print_warning "Launcher assets not found! Reggie... my dude..."
-    fi
-
     print_step "Launcher installed!"
 }
 
@@ -154,8 +145,8 @@ install_libraries() {
     cp -a "$REPO_ROOT/system/prebuilts/libmali-blobs"/icd.d/*.json "$ROOTFS_BUILD/usr/share/vulkan/icd.d/" || print_warning "Vulkan icd not found"
     cp -a "$SYSROOT"/libdrm.so* "$ROOTFS_BUILD/usr/lib/" 2>/dev/null || print_warning "libdrm not found"
 
-    # Additional libraries (SDL2)
-    cp -a "$BUILD_DIR"/sdl2-install/usr/lib/libSDL2*.so* "$ROOTFS_BUILD/usr/lib/" 2>/dev/null || print_warning "SDL2 not found"
+    # Additional libraries (SDL2), SDL2_image isn't needed by anything on the device
+    cp -a "$BUILD_DIR"/sdl2-install/usr/lib/libSDL2-2.0.so* "$ROOTFS_BUILD/usr/lib/" 2>/dev/null || print_warning "SDL2 not found"
 
     # Additional libraries (Emulators)
     # mupen64plus
@@ -186,6 +177,19 @@ install_kernel_modules() {
         # Remove development symlinks (build, source) that point to kernel source tree
         find "$ROOTFS_BUILD/lib/modules" -type l \( -name "build" -o -name "source" \) -delete
 
+        # Dependency and alias maps are generated here so rcS never has to
+        # scan the modules on the read-only rootfs at boot
+        local depmod_bin
+        depmod_bin="$(command -v depmod || echo /sbin/depmod)"
+        for kdir in "$ROOTFS_BUILD/lib/modules"/*; do
+            [ -d "$kdir" ] || continue
+            if [ -x "$depmod_bin" ]; then
+                "$depmod_bin" -b "$ROOTFS_BUILD" "$(basename "$kdir")"
+            else
+                print_warning "depmod not found, modules.dep will be built at boot"
+            fi
+        done
+
         print_step "Kernel modules installed!"
     else
         print_warning "No kernel modules found! Run 'make kernel' first."
@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+
+// Instrumented boot (make bench-image). init, rcS and the launcher drop
+// "mimiki-bench: <stage>" lines into the kernel log so every stage shares
+// the printk clock, this collects them into a TSV on the GAMES partition:
+// build tag, boot id, event, milliseconds
+#define BENCH_CMDLINE_KEY "mimiki.bench="
+#define BENCH_PREFIX      "mimiki-bench: "
+#define BENCH_DIR         "/mnt/games/data/bench"
+#define BENCH_LOG_PATH    BENCH_DIR "/boot.tsv"
+#define KMSG_PATH         "/dev/kmsg"
+#define KMSG_RECORD_MAX   8192
+
+static char bench_tag[64] = ""; // Empty unless booted from a bench image
+static char boot_id[16] = "";
+static uint64_t next_seq = 0;      // First kernel log record not yet collected
+static int suspend_count = 0;
+static uint64_t suspend_ts = 0;    // us, printk time of the current cycle's "suspend" mark
+static uint64_t cpus_up_ts = 0;
+
+void bench_init(void)
+{
+    char cmdline[1024];
+    int fd = open("/proc/cmdline", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    ssize_t n = read(fd, cmdline, sizeof(cmdline) - 1);
+    close(fd);
+    if (n <= 0)
+        return;
+    cmdline[n] = '\0';
+
+    const char *key = strstr(cmdline, BENCH_CMDLINE_KEY);
+    if (!key)
+        return;
+    key += strlen(BENCH_CMDLINE_KEY);
+    size_t len = strcspn(key, " \n");
+    if (len == 0 || len >= sizeof(bench_tag))
+        return;
+    memcpy(bench_tag, key, len);
+    bench_tag[len] = '\0';
+
+    // Enough of the boot id to tell boots apart in the log
+    fd = open("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        n = read(fd, boot_id, 8);
+        boot_id[n > 0 ? n : 0] = '\0';
+        close(fd);
+    }
+    printf("Benchmark boot, build %s\n", bench_tag);
+}
+
+bool bench_enabled(void)
+{
+    return bench_tag[0] != '\0';
+}
+
+// Names benchmark reports, "dev" outside a bench image
+const char *bench_build_tag(void)
+{
+    return bench_enabled() ? bench_tag : "dev";
+}
+
+const char *bench_boot_id(void)
+{
+    return boot_id;
+}
+
+void bench_mark(const char *stage)
+{
+    if (!bench_enabled())
+        return;
+
+    int fd = open(KMSG_PATH, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    char line[128];
+    int len = snprintf(line, sizeof(line), BENCH_PREFIX "%s\n", stage);
+    if (write(fd, line, len) != len)
+        fprintf(stderr, "Could not write bench mark: %s\n", strerror(errno));
+    close(fd);
+}
+
+static void log_event(FILE *fp, const char *event, uint64_t us)
+{
+    fprintf(fp, "%s\t%s\t%s\t%.1f\n", bench_tag, boot_id, event, us / 1000.0);
+}
+
+static void log_suspend_event(FILE *fp, const char *event, uint64_t us)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "suspend.%d.%s", suspend_count, event);
+    log_event(fp, name, us);
+}
+
+// One kernel log record, boot stages are logged as time since kernel start,
+// a suspend cycle's as time since its "suspend" mark (resume_latency is
+// from the CPUs coming back up)
+static void collect_record(FILE *fp, uint64_t ts, const char *msg)
+{
+    if (strncmp(msg, BENCH_PREFIX, strlen(BENCH_PREFIX)) == 0)
+    {
+        const char *stage = msg + strlen(BENCH_PREFIX);
+        if (strcmp(stage, "suspend") == 0)
+        {
+            suspend_count++;
+            suspend_ts = ts;
+            cpus_up_ts = 0;
+        }
+        else if (strcmp(stage, "resume") == 0 && suspend_ts)
+        {
+            log_suspend_event(fp, "resume", ts - suspend_ts);
+            // From the wakeup to the launcher running again
+            if (cpus_up_ts)
+                log_suspend_event(fp, "resume_latency", ts - cpus_up_ts);
+            suspend_ts = 0;
+        }
+        else
+        {
+            log_event(fp, stage, ts);
+        }
+        return;
+    }
+
+    if (strncmp(msg, "Run /init as init process", 25) == 0)
+    {
+        log_event(fp, "kernel.run_init", ts);
+        return;
+    }
+
+    if (!suspend_ts)
+        return;
+
+    if (strncmp(msg, "PM: suspend entry", 17) == 0)
+        log_suspend_event(fp, "pm_entry", ts - suspend_ts);
+    else if (strncmp(msg, "Disabling non-boot CPUs", 23) == 0)
+        log_suspend_event(fp, "cpus_down", ts - suspend_ts);
+    else if (strncmp(msg, "Enabling non-boot CPUs", 22) == 0)
+    {
+        cpus_up_ts = ts;
+        log_suspend_event(fp, "cpus_up", ts - suspend_ts);
+    }
+    else if (strncmp(msg, "PM: suspend exit", 16) == 0)
+        log_suspend_event(fp, "pm_exit", ts - suspend_ts);
+}
+
+// Appends whatever was logged since the last call. Stages that finish
+// later (the second card setup) are picked up by the next flush.
+void bench_flush(void)
+{
+    if (!bench_enabled())
+        return;
+
+    int kmsg = open(KMSG_PATH, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (kmsg < 0)
+    {
+        fprintf(stderr, "Could not read kernel log: %s\n", strerror(errno));
+        return;
+    }
+
+    mkdir(BENCH_DIR, 0755);
+    FILE *fp = fopen(BENCH_LOG_PATH, "a");
+    if (!fp)
+    {
+        fprintf(stderr, "Could not open %s: %s\n", BENCH_LOG_PATH, strerror(errno));
+        close(kmsg);
+        return;
+    }
+
+    static char record[KMSG_RECORD_MAX];
+    while (true)
+    {
+        ssize_t n = read(kmsg, record, sizeof(record) - 1);
+        if (n < 0 && (errno == EINTR || errno == EPIPE))
+            continue; // EPIPE: older records were overwritten, carry on with the next
+        if (n <= 0)
+            break;
+        record[n] = '\0';
+
+        // "prio,seq,ts_us,flags;message\n" followed by " KEY=value" lines
+        unsigned long long seq, ts;
+        char *msg = strchr(record, ';');
+        if (!msg || sscanf(record, "%*u,%llu,%llu", &seq, &ts) != 2)
+            continue;
+        msg++;
+        msg[strcspn(msg, "\n")] = '\0';
+
+        if (seq < next_seq)
+            continue;
+        next_seq = seq + 1;
+        collect_record(fp, ts, msg);
+    }
+    close(kmsg);
+
+    // The card may be pulled or the device powered off at any point
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+}
@@ -0,0 +1,511 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+// Regression benchmark (launcher --bench, or every bench image boot until
+// the build has a report). Each line of the list runs a system's emulator
+// headless with its bench_args for a fixed number of frames, the screen off
+// and nothing else running, with the same profile, governor and pinning a
+// game gets. The emulator's "bench: key=value ..." lines are kept as they
+// are; around each run the launcher adds CPU and GPU frequency residency and
+// battery energy. One JSON report per build tag in BENCH_REPORT_DIR.
+//
+// List format, one run per line, # starts a comment:
+//   <system short name> <frames> <ROM path>
+#define BENCH_LIST_PATH    "/mnt/games/data/bench/list.txt"
+#define BENCH_REPORT_DIR   "/mnt/games/data/bench"
+#define BENCH_RUN_TIMEOUT  1800 // Seconds before a run counts as hung
+#define BENCH_MAX_STATES   32
+#define BENCH_MAX_RESULTS  8    // bench: lines kept per run
+#define BENCH_RESULT_MAX   1024 // One result as JSON
+
+#define CPU_TIME_IN_STATE "/sys/devices/system/cpu/cpufreq/policy0/stats/time_in_state"
+#define GPU_TRANS_STAT    "/sys/class/devfreq/fde60000.gpu/trans_stat"
+
+typedef struct
+{
+    long      freq[BENCH_MAX_STATES];
+    long long ms[BENCH_MAX_STATES];
+    int       count;
+} Residency;
+
+typedef struct
+{
+    Residency cpu;
+    Residency gpu;
+    double    energy_uwh;  // -1 when the battery doesn't say
+    bool      discharging;
+    uint64_t  us;
+} Snapshot;
+
+static char battery_dir[128] = "";
+
+static void json_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(fp, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(fp, "\\u%04x", *c);
+        else
+            fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+// "<kHz> <10 ms units>" per line
+static void read_cpu_residency(Residency *res)
+{
+    res->count = 0;
+    FILE *fp = fopen(CPU_TIME_IN_STATE, "r");
+    if (!fp)
+        return;
+
+    long freq;
+    long long ticks;
+    while (res->count < BENCH_MAX_STATES && fscanf(fp, "%ld %lld", &freq, &ticks) == 2)
+    {
+        res->freq[res->count] = freq;
+        res->ms[res->count++] = ticks * 10;
+    }
+    fclose(fp);
+}
+
+// devfreq's transition table, "[*] <Hz>: <transitions...> <ms>" per state
+static void read_gpu_residency(Residency *res)
+{
+    res->count = 0;
+    FILE *fp = fopen(GPU_TRANS_STAT, "r");
+    if (!fp)
+        return;
+
+    char line[512];
+    while (res->count < BENCH_MAX_STATES && fgets(line, sizeof(line), fp))
+    {
+        char *str = ini_trim(line);
+        if (*str == '*')
+            str++;
+        char *end;
+        long freq = strtol(str, &end, 10);
+        char *last = strrchr(str, ' ');
+        if (end == str || *end != ':' || !last)
+            continue;
+
+        res->freq[res->count] = freq;
+        res->ms[res->count++] = atoll(last + 1);
+    }
+    fclose(fp);
+}
+
+static long read_battery_long(const char *name)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", battery_dir, name);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    long value = -1;
+    if (fscanf(fp, "%ld", &value) != 1)
+        value = -1;
+    fclose(fp);
+    return value;
+}
+
+// energy_now where the fuel gauge has it, charge times voltage otherwise
+static void read_battery(Snapshot *snap)
+{
+    snap->energy_uwh = -1;
+    snap->discharging = false;
+    if (!battery_dir[0])
+        return;
+
+    char path[PATH_MAX];
+    char status[32] = "";
+    snprintf(path, sizeof(path), "%s/status", battery_dir);
+    FILE *fp = fopen(path, "r");
+    if (fp)
+    {
+        if (!fgets(status, sizeof(status), fp))
+            status[0] = '\0';
+        fclose(fp);
+    }
+    snap->discharging = strncmp(status, "Discharging", 11) == 0;
+
+    long energy = read_battery_long("energy_now");
+    if (energy >= 0)
+    {
+        snap->energy_uwh = energy;
+        return;
+    }
+    long charge = read_battery_long("charge_now");   // uAh
+    long voltage = read_battery_long("voltage_now"); // uV
+    if (charge >= 0 && voltage > 0)
+        snap->energy_uwh = (double)charge * voltage / 1e6;
+}
+
+static void snapshot(Snapshot *snap)
+{
+    read_cpu_residency(&snap->cpu);
+    read_gpu_residency(&snap->gpu);
+    read_battery(snap);
+    snap->us = trace_now();
+}
+
+// Share of the run spent at each frequency, from the difference of two tables
+static void write_residency(FILE *fp, const char *name, const Residency *before, const Residency *after)
+{
+    long long total = 0;
+    for (int i = 0; i < after->count; i++)
+    {
+        if (i < before->count && before->freq[i] == after->freq[i])
+            total += after->ms[i] - before->ms[i];
+    }
+
+    fprintf(fp, "      \"%s\": {", name);
+    bool first = true;
+    for (int i = 0; i < after->count && total > 0; i++)
+    {
+        if (i >= before->count || before->freq[i] != after->freq[i])
+            continue;
+        long long ms = after->ms[i] - before->ms[i];
+        if (ms <= 0)
+            continue;
+        fprintf(fp, "%s\"%ld\": %.4f", first ? "" : ", ", after->freq[i], (double)ms / total);
+        first = false;
+    }
+    fprintf(fp, "}");
+}
+
+// "bench: a=1 b=x" as {"a": 1, "b": "x"}, numbers stay numbers
+static void format_result(char *out, size_t size, char *line)
+{
+    FILE *fp = fmemopen(out, size, "w");
+    if (!fp)
+    {
+        out[0] = '\0';
+        return;
+    }
+
+    fputc('{', fp);
+    bool first = true;
+    char *save;
+    for (char *tok = strtok_r(line, " \t\n", &save); tok; tok = strtok_r(NULL, " \t\n", &save))
+    {
+        char *eq = strchr(tok, '=');
+        if (!eq || eq == tok)
+            continue;
+        *eq = '\0';
+        const char *value = eq + 1;
+
+        fprintf(fp, "%s", first ? "" : ", ");
+        json_string(fp, tok);
+        fprintf(fp, ": ");
+        char *end;
+        strtod(value, &end);
+        if (*value && *end == '\0' && strspn(value, "0123456789.-+eE") == strlen(value))
+            fprintf(fp, "%s", value);
+        else
+            json_string(fp, value);
+        first = false;
+    }
+    fputc('}', fp);
+    fclose(fp);
+}
+
+static const System *find_system(const System *systems, int count, const char *short_name)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(systems[i].short_name, short_name) == 0)
+            return &systems[i];
+    }
+    return NULL;
+}
+
+// One line of emulator output: echoed to the log, kept if it's a result
+static void take_line(char *line, char results[][BENCH_RESULT_MAX], int *result_count)
+{
+    puts(line);
+    if (strncmp(line, "bench: ", 7) == 0 && *result_count < BENCH_MAX_RESULTS)
+        format_result(results[(*result_count)++], BENCH_RESULT_MAX, line + 7);
+}
+
+// Forks the emulator with its stdout on a pipe and waits for it under the
+// game's governor and pinning. The pipe is read raw and split into lines
+// here, so a partial line never blocks and the deadline is checked on every
+// wakeup. Returns the number of result lines kept.
+static int run_emulator(const System *sys, const char *rom, const char *frames, const Profile *profile,
+                        char results[][BENCH_RESULT_MAX], int *status, bool *timed_out)
+{
+    int out_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) != 0)
+    {
+        fprintf(stderr, "Could not create bench pipe: %s\n", strerror(errno));
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(out_pipe[1], STDOUT_FILENO);
+        profile_apply_child(profile);
+        launch_exec_bench(sys->launch, rom, frames, profile);
+        fprintf(stderr, "Failed to launch %s: %s\n", sys->launch->argv[0], strerror(errno));
+        _exit(127);
+    }
+    close(out_pipe[1]);
+    if (pid < 0)
+    {
+        fprintf(stderr, "Fork failed\n");
+        close(out_pipe[0]);
+        return -1;
+    }
+
+    char buf[512];
+    size_t len = 0;
+    int result_count = 0;
+    uint64_t deadline = trace_now() + BENCH_RUN_TIMEOUT * 1000000ull;
+    uint64_t next_pin = 0;
+    bool open = true;
+    *timed_out = false;
+    governor_start(profile);
+    while (open)
+    {
+        int timeout = governor_timeout();
+        if (timeout < 0 || timeout > 1000)
+            timeout = 1000;
+
+        struct pollfd pfd = {.fd = out_pipe[0], .events = POLLIN};
+        int ret = poll(&pfd, 1, timeout);
+        if (ret < 0 && errno != EINTR)
+            break;
+        if (ret > 0)
+        {
+            ssize_t n = read(out_pipe[0], buf + len, sizeof(buf) - 1 - len);
+            if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN))
+                open = false;
+            if (n > 0)
+                len += n;
+            buf[len] = '\0';
+
+            char *line = buf, *newline;
+            while ((newline = memchr(line, '\n', len - (line - buf))) != NULL)
+            {
+                *newline = '\0';
+                take_line(line, results, &result_count);
+                line = newline + 1;
+            }
+            len -= line - buf;
+            memmove(buf, line, len + 1);
+            // An overlong line or the last one without a newline
+            if (len > 0 && (len == sizeof(buf) - 1 || !open))
+            {
+                take_line(buf, results, &result_count);
+                len = 0;
+            }
+        }
+
+        uint64_t now = trace_now();
+        if (now >= deadline)
+        {
+            *timed_out = true;
+            break;
+        }
+        if (profile->isolate_cpu >= 0 && now >= next_pin)
+        {
+            profile_pin_threads(profile, pid);
+            next_pin = now + 1000000;
+        }
+        governor_poll();
+    }
+    governor_stop();
+    close(out_pipe[0]);
+
+    // stdout can close before the emulator exits, the deadline still holds
+    if (*timed_out)
+        kill(pid, SIGKILL);
+    while (true)
+    {
+        pid_t done = waitpid(pid, status, WNOHANG);
+        if (done == pid || (done < 0 && errno != EINTR))
+            break;
+        if (done == 0 && !*timed_out && trace_now() >= deadline)
+        {
+            *timed_out = true;
+            kill(pid, SIGKILL);
+        }
+        usleep(10000);
+    }
+    if (*timed_out)
+        fprintf(stderr, "Benchmark run hung, killed it\n");
+    launch_post_exit(sys->launch);
+    return result_count;
+}
+
+static void write_run(FILE *fp, bool first, const char *system, long frames, const char *rom)
+{
+    fprintf(fp, "%s    {\n      \"system\": ", first ? "" : ",\n");
+    json_string(fp, system);
+    fprintf(fp, ",\n      \"frames\": %ld,\n      \"rom\": ", frames);
+    json_string(fp, rom);
+    fprintf(fp, ",\n");
+}
+
+static void report_path_for_build(char *out, size_t size)
+{
+    snprintf(out, size, BENCH_REPORT_DIR "/%s.json", bench_build_tag());
+}
+
+// A bench image runs the list once, until the build has its report
+bool benchmark_due(void)
+{
+    char report_path[PATH_MAX];
+    report_path_for_build(report_path, sizeof(report_path));
+    return bench_enabled() && access(BENCH_LIST_PATH, R_OK) == 0 && access(report_path, F_OK) != 0;
+}
+
+// Runs every line of list_path (BENCH_LIST_PATH when NULL) and writes the
+// report. Returns the number of runs that exited cleanly with results, -1
+// without a list or report.
+int benchmark_run(const char *list_path, const System *systems, int count)
+{
+    const char *path = list_path ? list_path : BENCH_LIST_PATH;
+    FILE *list = fopen(path, "r");
+    if (!list)
+    {
+        if (list_path)
+            fprintf(stderr, "Could not open benchmark list %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char report_path[PATH_MAX], tmp_path[PATH_MAX];
+    report_path_for_build(report_path, sizeof(report_path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", report_path);
+    // A bench image boots into this until the build has its report
+    if (!list_path && access(report_path, F_OK) == 0)
+    {
+        fclose(list);
+        return -1;
+    }
+
+    mkdir(BENCH_REPORT_DIR, 0755);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "Could not write %s: %s\n", tmp_path, strerror(errno));
+        fclose(list);
+        return -1;
+    }
+
+    // The panel stays dark while the emulators run headless
+    control_init();
+    control_set_backlight(0);
+    if (!control_find_battery(battery_dir, sizeof(battery_dir)))
+        battery_dir[0] = '\0';
+
+    struct utsname uts;
+    if (uname(&uts) != 0)
+        uts.release[0] = '\0';
+    fprintf(fp, "{\n  \"build\": ");
+    json_string(fp, bench_build_tag());
+    fprintf(fp, ",\n  \"boot_id\": ");
+    json_string(fp, bench_boot_id());
+    fprintf(fp, ",\n  \"kernel\": ");
+    json_string(fp, uts.release);
+    fprintf(fp, ",\n  \"runs\": [\n");
+
+    // ROMs on the second card would look unreadable while it is mounting,
+    // and the report would keep them from being tried again
+    while (access(GAMES2_PENDING_PATH, F_OK) == 0)
+        usleep(20000);
+
+    printf("Benchmark: %s, build %s\n", path, bench_build_tag());
+    int runs = 0, passed = 0;
+    char line[PATH_MAX + 64];
+    while (fgets(line, sizeof(line), list))
+    {
+        char *str = ini_trim(line);
+        if (*str == '\0' || *str == '#')
+            continue;
+
+        char system[16], frames[16];
+        int rom_offset = 0;
+        if (sscanf(str, "%15s %15s %n", system, frames, &rom_offset) != 2 || !str[rom_offset] ||
+            atol(frames) <= 0)
+        {
+            fprintf(stderr, "Ignoring benchmark line: %s\n", str);
+            continue;
+        }
+        const char *rom = str + rom_offset;
+
+        write_run(fp, runs++ == 0, system, atol(frames), rom);
+        const System *sys = find_system(systems, count, system);
+        const char *skipped = !sys ? "unknown system" :
+                              !sys->launch->bench_args[0] ? "no bench_args" :
+                              access(rom, R_OK) != 0 ? "ROM not readable" : NULL;
+        if (skipped)
+        {
+            printf("Benchmark: skipping %s %s (%s)\n", system, rom, skipped);
+            fprintf(fp, "      \"skipped\": \"%s\"\n    }", skipped);
+            continue;
+        }
+
+        const char *slash = strrchr(rom, '/');
+        Profile profile;
+        profile_load(&profile, sys->launch->profile, NULL, slash ? slash + 1 : rom);
+        profile_apply(&profile);
+        printf("Benchmark: %s %s, %s frames\n", system, rom, frames);
+
+        static char results[BENCH_MAX_RESULTS][BENCH_RESULT_MAX];
+        Snapshot before, after;
+        int status = 0;
+        bool timed_out = false;
+        snapshot(&before);
+        int result_count = run_emulator(sys, rom, frames, &profile, results, &status, &timed_out);
+        snapshot(&after);
+        profile_reset();
+
+        bool ok = result_count > 0 && !timed_out && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        passed += ok;
+        fprintf(fp, "      \"ok\": %s,\n", ok ? "true" : "false");
+        int exit_code = result_count < 0 ? -1 : WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        fprintf(fp, "      \"exit\": %d,\n", exit_code);
+        fprintf(fp, "      \"timed_out\": %s,\n", timed_out ? "true" : "false");
+        fprintf(fp, "      \"seconds\": %.2f,\n", (after.us - before.us) / 1e6);
+        fprintf(fp, "      \"results\": [");
+        for (int i = 0; i < result_count; i++)
+            fprintf(fp, "%s%s", i ? ", " : "", results[i]);
+        fprintf(fp, "],\n");
+        write_residency(fp, "cpu_residency_khz", &before.cpu, &after.cpu);
+        fprintf(fp, ",\n");
+        write_residency(fp, "gpu_residency_hz", &before.gpu, &after.gpu);
+        fprintf(fp, ",\n");
+        // Only meaningful on battery, a charger hides the draw
+        if (before.discharging && after.discharging && before.energy_uwh >= 0 && after.energy_uwh >= 0)
+            fprintf(fp, "      \"energy_mwh\": %.1f\n    }", (before.energy_uwh - after.energy_uwh) / 1000.0);
+        else
+            fprintf(fp, "      \"energy_mwh\": null\n    }");
+    }
+    fclose(list);
+
+    fprintf(fp, "%s  ]\n}\n", runs ? "\n" : "");
+    bool written = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    written = fclose(fp) == 0 && written;
+    if (!written || rename(tmp_path, report_path) != 0)
+    {
+        fprintf(stderr, "Could not write %s: %s\n", report_path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+
+    printf("Benchmark: %d of %d runs ok, report in %s\n", passed, runs, report_path);
+    return passed;
+}
@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <ctype.h>
+
+// Growable game catalog. Every string (interned ROM directories, display
+// names and file names) lives in one arena, games are offsets into it.
+#define ARENA_INITIAL 4096
+#define INDEX_INITIAL 64
+
+void catalog_free(Catalog *cat)
+{
+    free(cat->arena);
+    free(cat->games);
+    memset(cat, 0, sizeof(*cat));
+}
+
+static bool arena_reserve(Catalog *cat, size_t len)
+{
+    if ((size_t)cat->arena_size + len <= cat->arena_cap)
+        return true;
+
+    size_t cap = cat->arena_cap ? cat->arena_cap : ARENA_INITIAL;
+    while (cap < (size_t)cat->arena_size + len)
+        cap *= 2;
+    if (cap > UINT32_MAX)
+        return false;
+
+    char *arena = realloc(cat->arena, cap);
+    if (!arena)
+        return false;
+
+    cat->arena = arena;
+    cat->arena_cap = cap;
+    return true;
+}
+
+static uint32_t arena_push(Catalog *cat, const char *str, size_t len)
+{
+    uint32_t offset = cat->arena_size;
+    memcpy(cat->arena + offset, str, len);
+    cat->arena[offset + len] = '\0';
+    cat->arena_size += len + 1;
+    return offset;
+}
+
+static bool index_reserve(Catalog *cat, int count)
+{
+    if (cat->count + count <= cat->cap)
+        return true;
+
+    int cap = cat->cap ? cat->cap : INDEX_INITIAL;
+    while (cap < cat->count + count)
+        cap *= 2;
+
+    Game *games = realloc(cat->games, cap * sizeof(Game));
+    if (!games)
+        return false;
+
+    cat->games = games;
+    cat->cap = cap;
+    return true;
+}
+
+int catalog_intern_dir(Catalog *cat, const char *dir)
+{
+    for (int i = 0; i < cat->dir_count; i++)
+    {
+        if (strcmp(cat->arena + cat->dirs[i], dir) == 0)
+            return i;
+    }
+
+    size_t len = strlen(dir);
+    if (cat->dir_count >= CATALOG_MAX_DIRS || !arena_reserve(cat, len + 1))
+        return -1;
+
+    cat->dirs[cat->dir_count] = arena_push(cat, dir, len);
+    return cat->dir_count++;
+}
+
+bool catalog_add(Catalog *cat, int dir, const char *name, const char *file)
+{
+    size_t name_len = strlen(name);
+    size_t file_len = strlen(file);
+    if (dir < 0 || !index_reserve(cat, 1) || !arena_reserve(cat, name_len * 2 + file_len + 3))
+        return false;
+
+    Game *game = &cat->games[cat->count++];
+    game->name = arena_push(cat, name, name_len);
+    game->file = arena_push(cat, file, file_len);
+    game->key = arena_push(cat, name, name_len);
+    for (char *c = cat->arena + game->key; *c; c++)
+        *c = (char)tolower((unsigned char)*c);
+    game->dir = dir;
+    return true;
+}
+
+bool catalog_merge(Catalog *dst, const Catalog *src)
+{
+    if (!index_reserve(dst, src->count) || !arena_reserve(dst, src->arena_size))
+        return false;
+
+    int dir_map[CATALOG_MAX_DIRS];
+    for (int i = 0; i < src->dir_count; i++)
+        dir_map[i] = catalog_intern_dir(dst, src->arena + src->dirs[i]);
+
+    for (int i = 0; i < src->count; i++)
+    {
+        const Game *game = &src->games[i];
+        if (!catalog_add(dst, dir_map[game->dir], src->arena + game->name, src->arena + game->file))
+            return false;
+    }
+    return true;
+}
+
+// Same order as strcasecmp() on the names
+static int compare_games(const void *a, const void *b, void *arena)
+{
+    const Game *game_a = (const Game *)a;
+    const Game *game_b = (const Game *)b;
+    return strcmp((const char *)arena + game_a->key, (const char *)arena + game_b->key);
+}
+
+// Letters jump between themselves, everything else is one '#' group
+static int initial_group(const char *key)
+{
+    return (*key >= 'a' && *key <= 'z') ? *key : '#';
+}
+
+void catalog_sort(Catalog *cat)
+{
+    if (cat->count > 1)
+        qsort_r(cat->games, cat->count, sizeof(Game), compare_games, cat->arena);
+
+    cat->jump_count = 0;
+    int last = -1;
+    for (int i = 0; i < cat->count && cat->jump_count < CATALOG_MAX_JUMPS; i++)
+    {
+        int group = initial_group(cat->arena + cat->games[i].key);
+        if (group != last)
+            cat->jumps[cat->jump_count++] = i;
+        last = group;
+    }
+}
+
+const char *catalog_name(const Catalog *cat, int index)
+{
+    return cat->arena + cat->games[index].name;
+}
+
+const char *catalog_key(const Catalog *cat, int index)
+{
+    return cat->arena + cat->games[index].key;
+}
+
+// First index whose key compares >= prefix (or > prefix with after set)
+static int lower_bound(const Catalog *cat, const char *prefix, size_t len, bool after)
+{
+    int lo = 0, hi = cat->count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strncmp(cat->arena + cat->games[mid].key, prefix, len);
+        if (cmp < 0 || (after && cmp == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Games whose lowercased name starts with prefix are [lo, hi), empty when lo == hi
+void catalog_prefix_range(const Catalog *cat, const char *prefix, int *lo, int *hi)
+{
+    size_t len = strlen(prefix);
+    *lo = lower_bound(cat, prefix, len, false);
+    *hi = lower_bound(cat, prefix, len, true);
+}
+
+// Start of the next initial letter, index itself when it's in the last group
+int catalog_next_letter(const Catalog *cat, int index)
+{
+    for (int i = 0; i < cat->jump_count; i++)
+    {
+        if (cat->jumps[i] > index)
+            return cat->jumps[i];
+    }
+    return index;
+}
+
+// Start of the current letter, or of the previous one when already there
+int catalog_prev_letter(const Catalog *cat, int index)
+{
+    for (int i = cat->jump_count - 1; i >= 0; i--)
+    {
+        if (cat->jumps[i] < index)
+            return cat->jumps[i];
+    }
+    return 0;
+}
+
+const char *catalog_file(const Catalog *cat, int index)
+{
+    return cat->arena + cat->games[index].file;
+}
+
+int catalog_path(const Catalog *cat, int index, char *buf, size_t size)
+{
+    const Game *game = &cat->games[index];
+    return snprintf(buf, size, "%s/%s", cat->arena + cat->dirs[game->dir], cat->arena + game->file);
+}
+
+// Artwork sits next to the ROMs: <dir>/media/<file without extension>.png
+int catalog_art_path(const Catalog *cat, int index, char *buf, size_t size)
+{
+    const Game *game = &cat->games[index];
+    const char *file = cat->arena + game->file;
+    const char *dot = strrchr(file, '.');
+    int stem = dot ? (int)(dot - file) : (int)strlen(file);
+    return snprintf(buf, size, "%s/media/%.*s.png", cat->arena + cat->dirs[game->dir], stem, file);
+}
@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <alsa/asoundlib.h>
+
+// Device controls used from the input path. Everything is opened once so a
+// keypress during gameplay costs a write() or an ioctl(), never a fork.
+#define BACKLIGHT_PATH   "/sys/class/backlight/backlight/brightness"
+#define POWER_STATE_PATH "/sys/power/state"
+#define POWER_SUPPLY_PATH "/sys/class/power_supply"
+#define MIXER_CARD       "hw:0"
+#define MIXER_MASTER     "Master"
+#define MIXER_OUTPUT_MUX "Playback Mux"
+
+static int backlight_fd = -1;
+static int power_state_fd = -1;
+static snd_mixer_t *mixer = NULL;
+static snd_mixer_elem_t *master_elem = NULL;
+static snd_ctl_t *ctl = NULL;
+
+static bool write_fd(int fd, const char *value)
+{
+    if (fd < 0)
+        return false;
+
+    // sysfs attributes take the whole value in a single write at offset 0
+    ssize_t len = (ssize_t)strlen(value);
+    while (pwrite(fd, value, len, 0) != len)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+static bool open_mixer(void)
+{
+    if (snd_mixer_open(&mixer, 0) < 0)
+        return false;
+
+    if (snd_mixer_attach(mixer, MIXER_CARD) < 0 ||
+        snd_mixer_selem_register(mixer, NULL, NULL) < 0 ||
+        snd_mixer_load(mixer) < 0)
+    {
+        snd_mixer_close(mixer);
+        mixer = NULL;
+        return false;
+    }
+
+    snd_mixer_selem_id_t *sid;
+    snd_mixer_selem_id_alloca(&sid);
+    snd_mixer_selem_id_set_name(sid, MIXER_MASTER);
+    master_elem = snd_mixer_find_selem(mixer, sid);
+    if (!master_elem || !snd_mixer_selem_has_playback_volume(master_elem))
+    {
+        fprintf(stderr, "Mixer control '%s' not found\n", MIXER_MASTER);
+        master_elem = NULL;
+    }
+    return true;
+}
+
+bool control_init(void)
+{
+    if (backlight_fd < 0)
+        backlight_fd = open(BACKLIGHT_PATH, O_WRONLY | O_CLOEXEC);
+    if (backlight_fd < 0)
+        fprintf(stderr, "Could not open backlight: %s\n", strerror(errno));
+
+    if (power_state_fd < 0)
+        power_state_fd = open(POWER_STATE_PATH, O_WRONLY | O_CLOEXEC);
+    if (power_state_fd < 0)
+        fprintf(stderr, "Could not open power state: %s\n", strerror(errno));
+
+    if (!mixer && !open_mixer())
+        fprintf(stderr, "Could not open mixer %s\n", MIXER_CARD);
+
+    if (!ctl && snd_ctl_open(&ctl, MIXER_CARD, 0) < 0)
+    {
+        fprintf(stderr, "Could not open control device %s\n", MIXER_CARD);
+        ctl = NULL;
+    }
+
+    return backlight_fd >= 0 && power_state_fd >= 0 && mixer && ctl;
+}
+
+bool control_set_backlight(int level)
+{
+    char value[16];
+    snprintf(value, sizeof(value), "%d\n", level);
+    return write_fd(backlight_fd, value);
+}
+
+// Blocks until the device resumes
+bool control_suspend(void)
+{
+    bench_mark("suspend");
+    bool ok = write_fd(power_state_fd, "mem\n");
+    bench_mark("resume");
+    bench_flush();
+    return ok;
+}
+
+// Same semantics as "amixer sset Master 5%+": percent of the volume range,
+// applied to every channel
+bool control_adjust_volume(int percent)
+{
+    if (!master_elem)
+        return false;
+
+    // Pick up changes made by the emulator since the last step
+    snd_mixer_handle_events(mixer);
+
+    long min, max;
+    if (snd_mixer_selem_get_playback_volume_range(master_elem, &min, &max) < 0 || max <= min)
+        return false;
+
+    long step = ((max - min) * percent) / 100;
+    if (step == 0)
+        step = percent > 0 ? 1 : -1;
+
+    bool ok = true;
+    for (int ch = 0; ch <= SND_MIXER_SCHN_LAST; ch++)
+    {
+        if (!snd_mixer_selem_has_playback_channel(master_elem, ch))
+            continue;
+
+        long volume;
+        if (snd_mixer_selem_get_playback_volume(master_elem, ch, &volume) < 0)
+            continue;
+
+        volume += step;
+        if (volume < min)
+            volume = min;
+        if (volume > max)
+            volume = max;
+        ok = snd_mixer_selem_set_playback_volume(master_elem, ch, volume) >= 0 && ok;
+    }
+    return ok;
+}
+
+// Switches the codec output mux between the speaker and the headphone jack
+bool control_set_headphones(bool headphones)
+{
+    if (!ctl)
+        return false;
+
+    const char *item_name = headphones ? "HP" : "SPK";
+    snd_ctl_elem_id_t *id;
+    snd_ctl_elem_info_t *info;
+    snd_ctl_elem_value_t *value;
+    snd_ctl_elem_id_alloca(&id);
+    snd_ctl_elem_info_alloca(&info);
+    snd_ctl_elem_value_alloca(&value);
+
+    snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+    snd_ctl_elem_id_set_name(id, MIXER_OUTPUT_MUX);
+    snd_ctl_elem_info_set_id(info, id);
+    if (snd_ctl_elem_info(ctl, info) < 0 ||
+        snd_ctl_elem_info_get_type(info) != SND_CTL_ELEM_TYPE_ENUMERATED)
+    {
+        fprintf(stderr, "Mixer control '%s' not found\n", MIXER_OUTPUT_MUX);
+        return false;
+    }
+
+    unsigned int items = snd_ctl_elem_info_get_items(info);
+    for (unsigned int i = 0; i < items; i++)
+    {
+        snd_ctl_elem_info_set_item(info, i);
+        if (snd_ctl_elem_info(ctl, info) < 0)
+            return false;
+        if (strcmp(snd_ctl_elem_info_get_item_name(info), item_name) != 0)
+            continue;
+
+        snd_ctl_elem_value_set_id(value, id);
+        for (unsigned int ch = 0; ch < snd_ctl_elem_info_get_count(info); ch++)
+            snd_ctl_elem_value_set_enumerated(value, ch, i);
+        return snd_ctl_elem_write(ctl, value) >= 0;
+    }
+    return false;
+}
+
+// Directory of the first power supply of type Battery, e.g.
+// /sys/class/power_supply/battery. Shared by the menu's indicator, the
+// runtime governor and the benchmark.
+bool control_find_battery(char *dir, size_t size)
+{
+    DIR *supplies = opendir(POWER_SUPPLY_PATH);
+    if (!supplies)
+        return false;
+
+    bool found = false;
+    struct dirent *entry;
+    while (!found && (entry = readdir(supplies)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char path[PATH_MAX];
+        char type[32] = "";
+        snprintf(path, sizeof(path), POWER_SUPPLY_PATH "/%s/type", entry->d_name);
+        FILE *fp = fopen(path, "r");
+        if (!fp)
+            continue;
+        if (!fgets(type, sizeof(type), fp))
+            type[0] = '\0';
+        fclose(fp);
+
+        found = strncmp(type, "Battery", 7) == 0 &&
+                snprintf(dir, size, POWER_SUPPLY_PATH "/%s", entry->d_name) < (int)size;
+    }
+    closedir(supplies);
+    return found;
+}
+
+void control_cleanup(void)
+{
+    if (backlight_fd >= 0)
+        close(backlight_fd);
+    if (power_state_fd >= 0)
+        close(power_state_fd);
+    backlight_fd = power_state_fd = -1;
+
+    if (mixer)
+        snd_mixer_close(mixer);
+    mixer = NULL;
+    master_elem = NULL;
+
+    if (ctl)
+        snd_ctl_close(ctl);
+    ctl = NULL;
+}
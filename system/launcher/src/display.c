@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+// DRM master handoff around a game. SDL keeps its device, window and
+// renderer, the launcher only gives up master so the emulator can modeset.
+// Whatever the emulator leaves on the CRTC when it exits is replaced with
+// the launcher's last frame once master is back.
+#define DISPLAY_MAX_CONNECTORS 4
+#define DISPLAY_RETRY_MS       5
+
+static int drm_fd = -1; // Owned by SDL
+static bool released = false;
+static uint32_t saved_crtc_id = 0;
+static uint32_t saved_fb_id = 0;
+static uint32_t saved_x = 0, saved_y = 0;
+static drmModeModeInfo saved_mode;
+static uint32_t saved_connectors[DISPLAY_MAX_CONNECTORS];
+static int saved_connector_count = 0;
+
+void display_attach(int fd)
+{
+    drm_fd = fd;
+    released = false;
+}
+
+// Remembers the CRTC the launcher is scanning out of and what drives it
+static bool save_crtc(void)
+{
+    drmModeRes *res = drmModeGetResources(drm_fd);
+    if (!res)
+        return false;
+
+    saved_crtc_id = 0;
+    for (int i = 0; i < res->count_crtcs && !saved_crtc_id; i++)
+    {
+        drmModeCrtc *crtc = drmModeGetCrtc(drm_fd, res->crtcs[i]);
+        if (!crtc)
+            continue;
+        if (crtc->buffer_id && crtc->mode_valid)
+        {
+            saved_crtc_id = crtc->crtc_id;
+            saved_fb_id = crtc->buffer_id;
+            saved_x = crtc->x;
+            saved_y = crtc->y;
+            saved_mode = crtc->mode;
+        }
+        drmModeFreeCrtc(crtc);
+    }
+
+    saved_connector_count = 0;
+    for (int i = 0; i < res->count_connectors && saved_crtc_id; i++)
+    {
+        drmModeConnector *conn = drmModeGetConnector(drm_fd, res->connectors[i]);
+        if (!conn)
+            continue;
+        drmModeEncoder *enc = conn->encoder_id ? drmModeGetEncoder(drm_fd, conn->encoder_id) : NULL;
+        if (enc && enc->crtc_id == saved_crtc_id && saved_connector_count < DISPLAY_MAX_CONNECTORS)
+            saved_connectors[saved_connector_count++] = conn->connector_id;
+        if (enc)
+            drmModeFreeEncoder(enc);
+        drmModeFreeConnector(conn);
+    }
+    drmModeFreeResources(res);
+
+    return saved_crtc_id && saved_connector_count > 0;
+}
+
+static bool restore_crtc(void)
+{
+    drmModeCrtc *crtc = drmModeGetCrtc(drm_fd, saved_crtc_id);
+    bool intact = crtc && crtc->buffer_id == saved_fb_id && crtc->mode_valid &&
+                  memcmp(&crtc->mode, &saved_mode, sizeof(saved_mode)) == 0;
+    if (crtc)
+        drmModeFreeCrtc(crtc);
+    if (intact)
+        return true;
+
+    if (drmModeSetCrtc(drm_fd, saved_crtc_id, saved_fb_id, saved_x, saved_y,
+                       saved_connectors, saved_connector_count, &saved_mode) != 0)
+    {
+        fprintf(stderr, "Could not restore the launcher's CRTC: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// Call after the last frame was presented. False means the display can't be
+// handed over and SDL has to be torn down instead.
+bool display_release(void)
+{
+    if (drm_fd < 0)
+        return false;
+
+    if (!save_crtc())
+    {
+        fprintf(stderr, "No active CRTC to hand over\n");
+        return false;
+    }
+
+    if (drmDropMaster(drm_fd) != 0)
+    {
+        fprintf(stderr, "Could not drop DRM master: %s\n", strerror(errno));
+        return false;
+    }
+    released = true;
+    return true;
+}
+
+// Call once the emulator has been reaped. Master only comes back once every
+// fd the emulator held is closed, so this retries until timeout_ms.
+bool display_reclaim(int timeout_ms)
+{
+    if (!released)
+        return false;
+
+    int waited = 0;
+    while (drmSetMaster(drm_fd) != 0)
+    {
+        if (waited >= timeout_ms)
+        {
+            fprintf(stderr, "Could not reacquire DRM master: %s\n", strerror(errno));
+            return false;
+        }
+        usleep(DISPLAY_RETRY_MS * 1000);
+        waited += DISPLAY_RETRY_MS;
+    }
+    released = false;
+
+    return restore_crtc();
+}
@@ -0,0 +1,325 @@
+#define _DEFAULT_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <pthread.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+// Binary index of every scanned ROM directory, so a boot with unchanged
+// libraries can skip readdir + name cleanup + sorting entirely
+#define CACHE_DIR      "/mnt/games/data/.cache"
+#define CACHE_PATH     CACHE_DIR "/games.idx"
+#define CACHE_TMP_PATH CACHE_DIR "/games.idx.tmp"
+#define CACHE_MAGIC    0x494B4D4Du // "MMKI"
+#define CACHE_VERSION  2
+#define CACHE_MAX_DIRS (MAX_SYSTEMS * 2)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dir_count;
+    uint32_t file_size;
+} CacheHeader;
+
+// Directory record, keyed on path + mtime/size signature and the system's
+// extension list, which systems.ini can change without touching the directory.
+// Data is game_count "display name\0file name\0" pairs.
+typedef struct
+{
+    char     path[32];
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+    int64_t  size;
+    uint32_t game_count;
+    uint32_t data_offset;
+    uint32_t data_size;
+    uint32_t ext_hash;
+} CacheDir;
+
+typedef struct
+{
+    CacheDir    dir;
+    const char *data; // Points into the mapping for hits, heap for fresh scans
+    bool        owned;
+} CacheRecord;
+
+static const uint8_t *cache_map = NULL;
+static size_t cache_map_size = 0;
+static CacheRecord records[CACHE_MAX_DIRS];
+static int record_count = 0;
+static bool cache_dirty = false;
+// Scan workers for both partitions share the record table
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const CacheDir *cache_dirs(void)
+{
+    return (const CacheDir *)(cache_map + sizeof(CacheHeader));
+}
+
+static bool cache_valid(const uint8_t *map, size_t size)
+{
+    if (size < sizeof(CacheHeader))
+        return false;
+
+    const CacheHeader *hdr = (const CacheHeader *)map;
+    if (hdr->magic != CACHE_MAGIC || hdr->version != CACHE_VERSION ||
+        hdr->file_size != size || hdr->dir_count > CACHE_MAX_DIRS)
+        return false;
+
+    if (sizeof(CacheHeader) + hdr->dir_count * sizeof(CacheDir) > size)
+        return false;
+
+    const CacheDir *dirs = (const CacheDir *)(map + sizeof(CacheHeader));
+    for (uint32_t i = 0; i < hdr->dir_count; i++)
+    {
+        uint64_t end = (uint64_t)dirs[i].data_offset + dirs[i].data_size;
+        if (end > size || memchr(dirs[i].path, '\0', sizeof(dirs[i].path)) == NULL)
+            return false;
+        // Data must end on a terminator so string walks can't run off the end
+        if (dirs[i].data_size > 0 && map[end - 1] != '\0')
+            return false;
+    }
+    return true;
+}
+
+bool game_cache_open(void)
+{
+    record_count = 0;
+    cache_dirty = false;
+
+    int fd = open(CACHE_PATH, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    if (!cache_valid(map, st.st_size))
+    {
+        fprintf(stderr, "Game cache invalid, rescanning\n");
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    madvise(map, st.st_size, MADV_WILLNEED);
+    cache_map = map;
+    cache_map_size = st.st_size;
+
+    printf("Game cache loaded (%u directories)\n", ((const CacheHeader *)map)->dir_count);
+    return true;
+}
+
+// FNV-1a over the lowercased extensions, matching is case-insensitive
+static uint32_t extensions_hash(const char **extensions)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; extensions && extensions[i]; i++)
+    {
+        for (const char *c = extensions[i]; *c; c++)
+            hash = (hash ^ (uint8_t)tolower((unsigned char)*c)) * 16777619u;
+        hash *= 16777619u; // A '\0' separator, so ".a" ".b" differs from ".a.b"
+    }
+    return hash;
+}
+
+static bool signature_matches(const CacheDir *dir, const struct stat *st, uint32_t ext_hash)
+{
+    return dir->mtime_sec == (int64_t)st->st_mtim.tv_sec &&
+           dir->mtime_nsec == (int64_t)st->st_mtim.tv_nsec &&
+           dir->size == (int64_t)st->st_size &&
+           dir->ext_hash == ext_hash;
+}
+
+static void fill_signature(CacheDir *dir, const char *path, const struct stat *st, uint32_t ext_hash)
+{
+    memset(dir, 0, sizeof(*dir));
+    snprintf(dir->path, sizeof(dir->path), "%s", path);
+    dir->mtime_sec = st->st_mtim.tv_sec;
+    dir->mtime_nsec = st->st_mtim.tv_nsec;
+    dir->size = st->st_size;
+    dir->ext_hash = ext_hash;
+}
+
+int game_cache_load(const char *dir, const struct stat *st, const char **extensions, Catalog *cat)
+{
+    pthread_mutex_lock(&cache_lock);
+    if (!cache_map || record_count >= CACHE_MAX_DIRS)
+    {
+        cache_dirty = true;
+        pthread_mutex_unlock(&cache_lock);
+        return -1;
+    }
+
+    const CacheHeader *hdr = (const CacheHeader *)cache_map;
+    const CacheDir *dirs = cache_dirs();
+
+    for (uint32_t i = 0; i < hdr->dir_count; i++)
+    {
+        if (strcmp(dirs[i].path, dir) != 0)
+            continue;
+
+        if (!signature_matches(&dirs[i], st, extensions_hash(extensions)))
+            break;
+
+        const char *data = (const char *)cache_map + dirs[i].data_offset;
+        const char *end = data + dirs[i].data_size;
+        const char *p = data;
+        int dir_index = catalog_intern_dir(cat, dir);
+        int count = 0;
+
+        while (count < (int)dirs[i].game_count && p < end)
+        {
+            const char *name = p;
+            const char *file = name + strlen(name) + 1;
+            if (file >= end || !catalog_add(cat, dir_index, name, file))
+                break;
+
+            count++;
+            p = file + strlen(file) + 1;
+        }
+
+        // Keep the record as-is for the next write, straight from the mapping
+        CacheRecord *rec = &records[record_count++];
+        rec->dir = dirs[i];
+        rec->data = data;
+        rec->owned = false;
+        pthread_mutex_unlock(&cache_lock);
+        return count;
+    }
+
+    cache_dirty = true;
+    pthread_mutex_unlock(&cache_lock);
+    return -1;
+}
+
+void game_cache_store(const char *dir, const struct stat *st, const char **extensions, const Catalog *cat)
+{
+    int count = cat->count;
+    size_t size = 0;
+    for (int i = 0; i < count; i++)
+        size += strlen(catalog_name(cat, i)) + 1 + strlen(catalog_file(cat, i)) + 1;
+
+    char *data = malloc(size ? size : 1);
+    if (!data)
+        return;
+
+    char *p = data;
+    for (int i = 0; i < count; i++)
+    {
+        size_t name_len = strlen(catalog_name(cat, i)) + 1;
+        size_t file_len = strlen(catalog_file(cat, i)) + 1;
+        memcpy(p, catalog_name(cat, i), name_len);
+        memcpy(p + name_len, catalog_file(cat, i), file_len);
+        p += name_len + file_len;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    if (record_count >= CACHE_MAX_DIRS)
+    {
+        pthread_mutex_unlock(&cache_lock);
+        free(data);
+        return;
+    }
+
+    CacheRecord *rec = &records[record_count++];
+    fill_signature(&rec->dir, dir, st, extensions_hash(extensions));
+    rec->dir.game_count = count;
+    rec->dir.data_size = size;
+    rec->data = data;
+    rec->owned = true;
+    cache_dirty = true;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool cache_write(void)
+{
+    mkdir(CACHE_DIR, 0755);
+
+    int fd = open(CACHE_TMP_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not write game cache: %s\n", strerror(errno));
+        return false;
+    }
+
+    uint32_t offset = sizeof(CacheHeader) + record_count * sizeof(CacheDir);
+    CacheDir dirs[CACHE_MAX_DIRS];
+    for (int i = 0; i < record_count; i++)
+    {
+        dirs[i] = records[i].dir;
+        dirs[i].data_offset = offset;
+        offset += dirs[i].data_size;
+    }
+
+    CacheHeader hdr = {CACHE_MAGIC, CACHE_VERSION, record_count, offset};
+    bool ok = write_all(fd, &hdr, sizeof(hdr)) &&
+              write_all(fd, dirs, record_count * sizeof(CacheDir));
+    for (int i = 0; ok && i < record_count; i++)
+        ok = write_all(fd, records[i].data, records[i].dir.data_size);
+
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+
+    if (!ok || rename(CACHE_TMP_PATH, CACHE_PATH) != 0)
+    {
+        fprintf(stderr, "Could not write game cache: %s\n", strerror(errno));
+        unlink(CACHE_TMP_PATH);
+        return false;
+    }
+
+    printf("Game cache updated (%d directories)\n", record_count);
+    return true;
+}
+
+void game_cache_close(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    if (cache_dirty)
+        cache_write();
+
+    for (int i = 0; i < record_count; i++)
+    {
+        if (records[i].owned)
+            free((void *)records[i].data);
+    }
+    record_count = 0;
+    cache_dirty = false;
+
+    if (cache_map)
+    {
+        munmap((void *)cache_map, cache_map_size);
+        cache_map = NULL;
+        cache_map_size = 0;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,340 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <glob.h>
+
+// Runtime clock ceilings while a game runs. The SoC's thermal zones are
+// sampled once a second and the CPU (soc zone) or GPU (gpu zone) ceiling is
+// stepped one OPP down when a zone gets close to its first passive trip,
+// before the kernel starts throttling in bigger steps, and back up once it
+// has cooled for a while. On a low, discharging battery the ceilings are
+// capped to stretch the remaining playtime. Nothing ever leaves the bounds
+// of the game's profile; profile_reset() restores the full range afterwards.
+#define GOV_INTERVAL_MS       1000
+#define GOV_BATTERY_SAMPLES   10     // Battery is read every 10th sample
+#define GOV_HOT_MARGIN        5000   // m°C below the trip point: step down
+#define GOV_COOL_MARGIN       12000  // m°C below the trip point: may step up
+#define GOV_COOL_SAMPLES      5      // Consecutive cool samples before stepping up
+#define GOV_DEFAULT_TRIP      85000
+#define GOV_LOW_BATTERY       20     // Percent
+#define GOV_LOW_BATTERY_CPU   1416000 // kHz
+#define GOV_LOW_BATTERY_GPU   400000000 // Hz
+#define GOV_MAX_ZONES         4
+#define GOV_MAX_OPPS          16
+
+#define CPU_POLICY  "/sys/devices/system/cpu/cpufreq/policy0"
+#define GPU_DEVFREQ "/sys/class/devfreq/fde60000.gpu"
+
+typedef struct
+{
+    const char *name;
+    long opps[GOV_MAX_OPPS]; // Ascending, in the unit max_fd takes
+    int  opp_count;
+    int  floor;              // Lowest OPP index the profile allows
+    int  top;                // Highest
+    int  ceiling;            // Currently written
+    int  cool_samples;
+    int  max_fd;
+} Domain;
+
+typedef struct
+{
+    int     fd;
+    long    trip;
+    Domain *domain;
+} Zone;
+
+static Domain cpu = {.name = "CPU", .max_fd = -1};
+static Domain gpu = {.name = "GPU", .max_fd = -1};
+static Zone zones[GOV_MAX_ZONES];
+static int zone_count = 0;
+static int battery_capacity_fd = -1;
+static int battery_status_fd = -1;
+static bool low_battery = false;
+static bool running = false;
+static int samples = 0;
+static uint64_t next_sample_ms = 0;
+
+static uint64_t now_ms(void)
+{
+    return trace_now() / 1000;
+}
+
+static ssize_t read_fd(int fd, char *buf, size_t size)
+{
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    buf[n > 0 ? n : 0] = '\0';
+    return n;
+}
+
+static long read_fd_long(int fd)
+{
+    char buf[32];
+    return (fd >= 0 && read_fd(fd, buf, sizeof(buf)) > 0) ? atol(buf) : -1;
+}
+
+static long read_path_long(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    long value = read_fd_long(fd);
+    if (fd >= 0)
+        close(fd);
+    return value;
+}
+
+static int compare_long(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// OPP table from a space separated sysfs list, the ceiling starts at the top
+static bool open_domain(Domain *domain, const char *opp_path, const char *max_path,
+                        long min_freq, long max_freq)
+{
+    char buf[512];
+    int fd = open(opp_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    ssize_t n = read_fd(fd, buf, sizeof(buf));
+    close(fd);
+    if (n <= 0)
+        return false;
+
+    domain->opp_count = 0;
+    char *save;
+    for (char *tok = strtok_r(buf, " \n", &save); tok && domain->opp_count < GOV_MAX_OPPS;
+         tok = strtok_r(NULL, " \n", &save))
+        domain->opps[domain->opp_count++] = atol(tok);
+    if (domain->opp_count == 0)
+        return false;
+    qsort(domain->opps, domain->opp_count, sizeof(long), compare_long);
+
+    domain->floor = 0;
+    domain->top = domain->opp_count - 1;
+    while (min_freq > 0 && domain->floor < domain->top && domain->opps[domain->floor] < min_freq)
+        domain->floor++;
+    while (max_freq > 0 && domain->top > domain->floor && domain->opps[domain->top] > max_freq)
+        domain->top--;
+    domain->ceiling = domain->top;
+    domain->cool_samples = 0;
+
+    domain->max_fd = open(max_path, O_WRONLY | O_CLOEXEC);
+    return domain->max_fd >= 0;
+}
+
+static void close_domain(Domain *domain)
+{
+    if (domain->max_fd >= 0)
+        close(domain->max_fd);
+    domain->max_fd = -1;
+}
+
+static void set_ceiling(Domain *domain, int index, const char *reason)
+{
+    if (index == domain->ceiling || domain->max_fd < 0)
+        return;
+
+    char value[32];
+    int len = snprintf(value, sizeof(value), "%ld\n", domain->opps[index]);
+    if (pwrite(domain->max_fd, value, len, 0) != len)
+    {
+        fprintf(stderr, "Could not set %s ceiling: %s\n", domain->name, strerror(errno));
+        return;
+    }
+    domain->ceiling = index;
+    printf("%s ceiling %ld (%s)\n", domain->name, domain->opps[index], reason);
+}
+
+// Highest OPP index allowed right now, the low battery cap never goes below the floor
+static int allowed_top(const Domain *domain, long low_battery_cap)
+{
+    int top = domain->top;
+    while (low_battery && top > domain->floor && domain->opps[top] > low_battery_cap)
+        top--;
+    return top;
+}
+
+// Lowest passive trip of a zone, the first point where the kernel throttles
+static long zone_trip(const char *zone_dir)
+{
+    long trip = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        char path[PATH_MAX];
+        char type[32];
+        snprintf(path, sizeof(path), "%s/trip_point_%d_type", zone_dir, i);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            break;
+        read_fd(fd, type, sizeof(type));
+        close(fd);
+        if (strncmp(type, "passive", 7) != 0)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/trip_point_%d_temp", zone_dir, i);
+        long temp = read_path_long(path);
+        if (temp > 0 && (trip == 0 || temp < trip))
+            trip = temp;
+    }
+    return trip ? trip : GOV_DEFAULT_TRIP;
+}
+
+static void open_zones(void)
+{
+    glob_t found;
+    zone_count = 0;
+    if (glob("/sys/class/thermal/thermal_zone*", 0, NULL, &found) != 0)
+        return;
+
+    for (size_t i = 0; i < found.gl_pathc && zone_count < GOV_MAX_ZONES; i++)
+    {
+        char path[PATH_MAX];
+        char type[32];
+        snprintf(path, sizeof(path), "%s/type", found.gl_pathv[i]);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        read_fd(fd, type, sizeof(type));
+        close(fd);
+
+        snprintf(path, sizeof(path), "%s/temp", found.gl_pathv[i]);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+
+        Zone *zone = &zones[zone_count++];
+        zone->fd = fd;
+        zone->trip = zone_trip(found.gl_pathv[i]);
+        zone->domain = strstr(type, "gpu") ? &gpu : &cpu;
+    }
+    globfree(&found);
+}
+
+static void open_battery(void)
+{
+    char dir[128], path[160];
+    if (!control_find_battery(dir, sizeof(dir)))
+        return;
+
+    snprintf(path, sizeof(path), "%s/capacity", dir);
+    battery_capacity_fd = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "%s/status", dir);
+    battery_status_fd = open(path, O_RDONLY | O_CLOEXEC);
+}
+
+void governor_start(const Profile *profile)
+{
+    running = false;
+    bool have_cpu = open_domain(&cpu, CPU_POLICY "/scaling_available_frequencies",
+                                CPU_POLICY "/scaling_max_freq",
+                                profile->cpu_min_freq, profile->cpu_max_freq);
+    bool have_gpu = open_domain(&gpu, GPU_DEVFREQ "/available_frequencies", GPU_DEVFREQ "/max_freq",
+                                profile->gpu_min_freq, profile->gpu_max_freq);
+    if (!have_cpu && !have_gpu)
+    {
+        fprintf(stderr, "No clock controls, runtime governor off\n");
+        governor_stop();
+        return;
+    }
+
+    open_zones();
+    open_battery();
+    low_battery = false;
+    samples = 0;
+    next_sample_ms = now_ms();
+    running = true;
+}
+
+void governor_stop(void)
+{
+    close_domain(&cpu);
+    close_domain(&gpu);
+    for (int i = 0; i < zone_count; i++)
+        close(zones[i].fd);
+    zone_count = 0;
+    if (battery_capacity_fd >= 0)
+        close(battery_capacity_fd);
+    if (battery_status_fd >= 0)
+        close(battery_status_fd);
+    battery_capacity_fd = battery_status_fd = -1;
+    running = false;
+}
+
+// Milliseconds until the next sample is due, -1 when not running
+int governor_timeout(void)
+{
+    if (!running)
+        return -1;
+    uint64_t now = now_ms();
+    return now >= next_sample_ms ? 0 : (int)(next_sample_ms - now);
+}
+
+static void sample_battery(void)
+{
+    char status[32] = "";
+    if (battery_status_fd >= 0)
+        read_fd(battery_status_fd, status, sizeof(status));
+    long capacity = read_fd_long(battery_capacity_fd);
+
+    bool low = capacity >= 0 && capacity <= GOV_LOW_BATTERY && strncmp(status, "Discharging", 11) == 0;
+    if (low != low_battery)
+        printf("Battery %ld%%, low battery clocks %s\n", capacity, low ? "on" : "off");
+    low_battery = low;
+}
+
+// headroom is the domain's closest distance to a trip point, LONG_MAX without a zone
+static void step_domain(Domain *domain, long headroom, long low_battery_cap)
+{
+    if (domain->max_fd < 0)
+        return;
+
+    int top = allowed_top(domain, low_battery_cap);
+    if (domain->ceiling > top)
+    {
+        set_ceiling(domain, top, "low battery");
+        return;
+    }
+
+    if (headroom < GOV_HOT_MARGIN)
+    {
+        domain->cool_samples = 0;
+        if (domain->ceiling > domain->floor)
+            set_ceiling(domain, domain->ceiling - 1, "hot");
+        return;
+    }
+
+    if (headroom > GOV_COOL_MARGIN && domain->ceiling < top &&
+        ++domain->cool_samples >= GOV_COOL_SAMPLES)
+    {
+        domain->cool_samples = 0;
+        set_ceiling(domain, domain->ceiling + 1, headroom == LONG_MAX ? "restored" : "cool");
+    }
+}
+
+// Samples and adjusts once due, call whenever the game loop wakes up
+void governor_poll(void)
+{
+    if (!running || governor_timeout() > 0)
+        return;
+    next_sample_ms = now_ms() + GOV_INTERVAL_MS;
+
+    if (samples++ % GOV_BATTERY_SAMPLES == 0)
+        sample_battery();
+
+    long cpu_headroom = LONG_MAX, gpu_headroom = LONG_MAX;
+    for (int i = 0; i < zone_count; i++)
+    {
+        long temp = read_fd_long(zones[i].fd);
+        if (temp < 0)
+            continue;
+        long headroom = zones[i].trip - temp;
+        long *worst = zones[i].domain == &gpu ? &gpu_headroom : &cpu_headroom;
+        if (headroom < *worst)
+            *worst = headroom;
+    }
+
+    step_domain(&cpu, cpu_headroom, GOV_LOW_BATTERY_CPU);
+    step_domain(&gpu, gpu_headroom, GOV_LOW_BATTERY_GPU);
+}
@@ -0,0 +1,61 @@
+#define _DEFAULT_SOURCE
+
+#include "shared.h"
+#include <ctype.h>
+
+// Line reader for the launcher's ini files (systems.ini, profiles.ini):
+// '#' and ';' start comment lines, "[section]" opens a section and
+// "key = value" sets a key in it, whitespace around names and values is
+// dropped. What the keys mean is up to each file's handler.
+
+char *ini_trim(char *str)
+{
+    while (isspace((unsigned char)*str))
+        str++;
+
+    char *end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return str;
+}
+
+// The handler is called once per section header with key and value NULL,
+// then once per key. Keys before the first header get a NULL section.
+// Returns false if the file can't be opened.
+bool ini_parse(const char *path, IniHandler handler, void *ctx)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return false;
+
+    char section[512];
+    bool in_section = false;
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char *str = ini_trim(line);
+        if (*str == '\0' || *str == '#' || *str == ';')
+            continue;
+
+        if (*str == '[')
+        {
+            char *close = strrchr(str, ']');
+            if (close)
+                *close = '\0';
+            snprintf(section, sizeof(section), "%s", ini_trim(str + 1));
+            in_section = true;
+            handler(ctx, section, NULL, NULL);
+            continue;
+        }
+
+        char *eq = strchr(str, '=');
+        if (!eq)
+            continue;
+
+        *eq = '\0';
+        handler(ctx, in_section ? section : NULL, ini_trim(str), ini_trim(eq + 1));
+    }
+
+    fclose(fp);
+    return true;
+}
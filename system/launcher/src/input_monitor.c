@@ -1,11 +1,25 @@
 #define _GNU_SOURCE
 
 #include "shared.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
 
 #define MAX_INPUT_DEVICES 4
 #define WAKE_DEBOUNCE_MS 500
+#define POWER_HOLD_MS 1750
 
 static int input_fds[MAX_INPUT_DEVICES] = {-1, -1, -1, -1};
 static int num_devices = 0;
@@ -15,10 +29,42 @@ static bool power_button_held = false;
 static bool mode_button_held = false;
 static bool start_button_held = false;
 static bool headphones_inserted = false;
+static int power_timer_fd = -1; // Fires once the power button has been held long enough
+
+// In-game watcher thread, reports to the main thread through watch_event_fd
+static pthread_t watch_thread;
+static bool watch_running = false;
+static int watch_event_fd = -1;
+static int watch_stop_fd = -1;
+static pid_t watch_pid = 0;
+static atomic_int watch_hotkey = HOTKEY_NONE;
+static atomic_bool watch_exited = false;
 
 // Brightness: 4-100% in 7 steps of 16, default to ~50%
 static int current_brightness = 52;
 
+static long ms_since(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 +
+           (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+static void arm_power_timer(bool arm)
+{
+    if (power_timer_fd < 0)
+        return;
+
+    struct itimerspec spec = {0};
+    if (arm)
+    {
+        spec.it_value.tv_sec = POWER_HOLD_MS / 1000;
+        spec.it_value.tv_nsec = (POWER_HOLD_MS % 1000) * 1000000L;
+    }
+    timerfd_settime(power_timer_fd, 0, &spec, NULL);
+}
+
 static int find_device_by_name(const char *device_name)
 {
     DIR *dir = opendir("/dev/input");
@@ -76,6 +122,9 @@ bool input_monitor_init(void)
         }
     }
 
+    if (power_timer_fd < 0)
+        power_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
     if (num_devices == 0)
     {
         fprintf(stderr, "Failed to open any input devices\n");
@@ -112,24 +161,20 @@ int input_monitor_check_hotkeys(void)
                 {
                     clock_gettime(CLOCK_MONOTONIC, &power_press_time);
                     power_button_held = true;
+                    arm_power_timer(true);
                 }
                 else if (ev.value == 0 && power_button_held)
                 {
-                    struct timespec now;
-                    clock_gettime(CLOCK_MONOTONIC, &now);
-                    long held_ms = (now.tv_sec - power_press_time.tv_sec) * 1000 +
-                                   (now.tv_nsec - power_press_time.tv_nsec) / 1000000;
                     power_button_held = false;
+                    arm_power_timer(false);
 
-                    if (held_ms >= 1750)
+                    if (ms_since(&power_press_time) >= POWER_HOLD_MS)
                         return HOTKEY_SHUTDOWN;
 
-                    long last_wake_ms = (now.tv_sec - last_wake_time.tv_sec) * 1000 +
-                                        (now.tv_nsec - last_wake_time.tv_nsec) / 1000000;
-                    if (last_wake_ms < WAKE_DEBOUNCE_MS)
+                    if (ms_since(&last_wake_time) < WAKE_DEBOUNCE_MS)
                         continue;
 
-                    system("echo mem > /sys/power/state");
+                    control_suspend();
                     clock_gettime(CLOCK_MONOTONIC, &last_wake_time);
                 }
                 break;
@@ -144,16 +189,12 @@ int input_monitor_check_hotkeys(void)
                     if (current_brightness < 100)
                     {
                         current_brightness += 16;
-                        char cmd[128];
-                        snprintf(cmd, sizeof(cmd),
-                                 "echo %d > /sys/class/backlight/backlight/brightness",
-                                 (int)(current_brightness * 255 / 100));
-                        system(cmd);
+                        control_set_backlight(current_brightness * 255 / 100);
                     }
                 }
                 else
                 {
-                    system("amixer -q -c 0 sset 'Master' 5%+");
+                    control_adjust_volume(5);
                 }
                 break;
 
@@ -166,16 +207,12 @@ int input_monitor_check_hotkeys(void)
                     if (current_brightness > 4)
                     {
                         current_brightness -= 16;
-                        char cmd[128];
-                        snprintf(cmd, sizeof(cmd),
-                                 "echo %d > /sys/class/backlight/backlight/brightness",
-                                 (int)(current_brightness * 255 / 100));
-                        system(cmd);
+                        control_set_backlight(current_brightness * 255 / 100);
                     }
                 }
                 else
                 {
-                    system("amixer -q -c 0 sset 'Master' 5%-");
+                    control_adjust_volume(-5);
                 }
                 break;
 
@@ -188,7 +225,7 @@ int input_monitor_check_hotkeys(void)
             case SW_LID:
                 if (ev.value == 1)
                 {
-                    system("echo mem > /sys/power/state");
+                    control_suspend();
                     clock_gettime(CLOCK_MONOTONIC, &last_wake_time);
                 }
                 break;
@@ -197,29 +234,211 @@ int input_monitor_check_hotkeys(void)
                 // Only switch modes once on change rather than per loop
                 if (ev.value == 0 && headphones_inserted)
                 {
-                    system("amixer -q -c 0 cset name='Playback Mux' SPK");
+                    control_set_headphones(false);
                     headphones_inserted = false;
                 }
                 else if (ev.value == 1 && !headphones_inserted)
                 {
-                    system("amixer -q -c 0 cset name='Playback Mux' HP");
+                    control_set_headphones(true);
                     headphones_inserted = true;
                 }
             }
         }
     }
 
+    if (power_button_held && ms_since(&power_press_time) >= POWER_HOLD_MS)
+        return HOTKEY_SHUTDOWN;
+
+    return HOTKEY_NONE;
+}
+
+#define MAX_WAKE_FDS 4
+
+int input_monitor_wait(int timeout_ms, const int *wake_fds, int wake_count)
+{
+    struct pollfd fds[MAX_INPUT_DEVICES + MAX_WAKE_FDS];
+    int count = 0;
+
+    for (int i = 0; i < num_devices; i++)
+    {
+        if (input_fds[i] >= 0)
+        {
+            fds[count].fd = input_fds[i];
+            fds[count].events = POLLIN;
+            count++;
+        }
+    }
+
+    if (count == 0)
+        return -1;
+
+    for (int i = 0; i < wake_count && i < MAX_WAKE_FDS; i++)
+    {
+        if (wake_fds[i] < 0)
+            continue;
+        fds[count].fd = wake_fds[i];
+        fds[count].events = POLLIN;
+        count++;
+    }
+
+    // Wake up in time to report a held power button
     if (power_button_held)
     {
-        struct timespec now;
-        clock_gettime(CLOCK_MONOTONIC, &now);
-        long held_ms = (now.tv_sec - power_press_time.tv_sec) * 1000 +
-                       (now.tv_nsec - power_press_time.tv_nsec) / 1000000;
-        if (held_ms >= 1750)
-            return HOTKEY_SHUTDOWN;
+        long remaining = POWER_HOLD_MS - ms_since(&power_press_time);
+        if (remaining < 0)
+            remaining = 0;
+        if (timeout_ms < 0 || remaining < timeout_ms)
+            timeout_ms = (int)remaining;
     }
 
-    return HOTKEY_NONE;
+    int ret = poll(fds, count, timeout_ms);
+    if (ret < 0 && errno == EINTR)
+        return 0;
+    return ret;
+}
+
+static bool epoll_add(int epfd, int fd)
+{
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+    return fd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+static void *watch_worker(void *arg)
+{
+    (void)arg;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        fprintf(stderr, "Could not create epoll instance: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    // Without a pidfd the child is checked every 100 ms instead
+    int pidfd = (int)syscall(SYS_pidfd_open, watch_pid, 0);
+    if (pidfd < 0)
+        fprintf(stderr, "pidfd_open failed: %s\n", strerror(errno));
+
+    for (int i = 0; i < num_devices; i++)
+        epoll_add(epfd, input_fds[i]);
+    epoll_add(epfd, power_timer_fd);
+    epoll_add(epfd, watch_stop_fd);
+    epoll_add(epfd, pidfd);
+
+    while (true)
+    {
+        struct epoll_event events[MAX_INPUT_DEVICES + 3];
+        int n = epoll_wait(epfd, events, MAX_INPUT_DEVICES + 3, pidfd < 0 ? 100 : -1);
+        if (n < 0 && errno != EINTR)
+            break;
+
+        bool stop = false;
+        bool exited = false;
+        bool input = false;
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == watch_stop_fd)
+            {
+                stop = true;
+            }
+            else if (fd == pidfd)
+            {
+                exited = true;
+            }
+            else if (fd == power_timer_fd)
+            {
+                uint64_t expirations;
+                read(power_timer_fd, &expirations, sizeof(expirations));
+                input = true;
+            }
+            else
+            {
+                input = true;
+            }
+        }
+
+        if (stop)
+            break;
+
+        if (pidfd < 0)
+        {
+            siginfo_t info = {0};
+            exited = waitid(P_PID, watch_pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 &&
+                     info.si_pid == watch_pid;
+        }
+
+        int hotkey = input ? input_monitor_check_hotkeys() : HOTKEY_NONE;
+        if (hotkey != HOTKEY_NONE || exited)
+        {
+            atomic_store(&watch_hotkey, hotkey);
+            atomic_store(&watch_exited, exited);
+            uint64_t one = 1;
+            write(watch_event_fd, &one, sizeof(one));
+            break;
+        }
+    }
+
+    if (pidfd >= 0)
+        close(pidfd);
+    close(epfd);
+    return NULL;
+}
+
+bool input_monitor_watch_start(pid_t pid)
+{
+    watch_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    watch_stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watch_event_fd < 0 || watch_stop_fd < 0)
+    {
+        fprintf(stderr, "Could not create watch eventfd: %s\n", strerror(errno));
+        input_monitor_watch_stop();
+        return false;
+    }
+
+    watch_pid = pid;
+    atomic_store(&watch_hotkey, HOTKEY_NONE);
+    atomic_store(&watch_exited, false);
+    if (pthread_create(&watch_thread, NULL, watch_worker, NULL) != 0)
+    {
+        fprintf(stderr, "Could not start input watch thread\n");
+        input_monitor_watch_stop();
+        return false;
+    }
+
+    watch_running = true;
+    return true;
+}
+
+int input_monitor_watch_wait(int timeout_ms, bool *exited)
+{
+    *exited = false;
+
+    struct pollfd pfd = {.fd = watch_event_fd, .events = POLLIN};
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+        return HOTKEY_NONE;
+
+    uint64_t value;
+    read(watch_event_fd, &value, sizeof(value));
+    *exited = atomic_load(&watch_exited);
+    return atomic_load(&watch_hotkey);
+}
+
+void input_monitor_watch_stop(void)
+{
+    if (watch_running)
+    {
+        uint64_t one = 1;
+        write(watch_stop_fd, &one, sizeof(one));
+        pthread_join(watch_thread, NULL);
+        watch_running = false;
+    }
+
+    if (watch_event_fd >= 0)
+        close(watch_event_fd);
+    if (watch_stop_fd >= 0)
+        close(watch_stop_fd);
+    watch_event_fd = watch_stop_fd = -1;
 }
 
 void input_monitor_cleanup(void)
@@ -233,6 +452,7 @@ void input_monitor_cleanup(void)
         }
     }
     num_devices = 0;
+    arm_power_timer(false);
     mode_button_held = false;
     power_button_held = false;
     start_button_held = false;
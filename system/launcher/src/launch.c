@@ -0,0 +1,274 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <sys/wait.h>
+
+// Systems and how to start their emulators. [<short name>] sections in menu
+// order, the user's file can change keys of a shipped system or add one.
+// Everything is resolved once here so a launch only copies pointers.
+#define LAUNCH_SYSTEM_PATH  "/etc/mimiki/systems.ini"
+#define LAUNCH_USER_PATH    "/mnt/games/data/systems.ini"
+#define LAUNCH_ROM_TOKEN    "%rom"
+#define LAUNCH_FRAMES_TOKEN "%frames"
+
+extern char **environ;
+
+static Launch launches[MAX_SYSTEMS];
+static int launch_count = 0;
+
+static Launch *find_or_add(const char *short_name)
+{
+    for (int i = 0; i < launch_count; i++)
+    {
+        if (strcmp(launches[i].short_name, short_name) == 0)
+            return &launches[i];
+    }
+
+    if (launch_count >= MAX_SYSTEMS || strlen(short_name) >= sizeof(launches[0].short_name))
+    {
+        fprintf(stderr, "Ignoring system [%s]\n", short_name);
+        return NULL;
+    }
+
+    Launch *launch = &launches[launch_count++];
+    memset(launch, 0, sizeof(*launch));
+    snprintf(launch->short_name, sizeof(launch->short_name), "%s", short_name);
+    return launch;
+}
+
+// env and prefetch add to what earlier lines set, everything else replaces it
+static void apply_key(Launch *launch, const char *key, const char *value)
+{
+    if (strcmp(key, "name") == 0)
+        snprintf(launch->name, sizeof(launch->name), "%s", value);
+    else if (strcmp(key, "binary") == 0)
+        snprintf(launch->binary, sizeof(launch->binary), "%s", value);
+    else if (strcmp(key, "args") == 0)
+        snprintf(launch->args, sizeof(launch->args), "%s", value);
+    else if (strcmp(key, "extensions") == 0)
+        snprintf(launch->extensions, sizeof(launch->extensions), "%s", value);
+    else if (strcmp(key, "profile") == 0)
+        snprintf(launch->profile, sizeof(launch->profile), "%s", value);
+    else if (strcmp(key, "post_exit") == 0)
+        snprintf(launch->post_exit, sizeof(launch->post_exit), "%s", value);
+    else if (strcmp(key, "bench_args") == 0)
+        snprintf(launch->bench_args, sizeof(launch->bench_args), "%s", value);
+    else if (strcmp(key, "env") == 0)
+    {
+        if (!strchr(value, '=') || launch->env_count >= LAUNCH_MAX_ENV)
+            fprintf(stderr, "Ignoring env for %s: %s\n", launch->short_name, value);
+        else
+            snprintf(launch->env[launch->env_count++], sizeof(launch->env[0]), "%s", value);
+    }
+    else if (strcmp(key, "prefetch") == 0)
+    {
+        if (launch->prefetch_count >= LAUNCH_MAX_PREFETCH)
+            fprintf(stderr, "Ignoring prefetch for %s: %s\n", launch->short_name, value);
+        else
+            snprintf(launch->prefetch_paths[launch->prefetch_count++], sizeof(launch->prefetch_paths[0]),
+                     "%s", value);
+    }
+    else
+        fprintf(stderr, "Unknown system key: %s\n", key);
+}
+
+// ctx is the Launch of the current section, NULL until the first one
+static void load_key(void *ctx, const char *section, const char *key, const char *value)
+{
+    Launch **launch = ctx;
+    if (!key)
+        *launch = find_or_add(section);
+    else if (*launch)
+        apply_key(*launch, key, value);
+}
+
+static void load_file(const char *path)
+{
+    Launch *launch = NULL;
+    ini_parse(path, load_key, &launch);
+}
+
+// The launcher's environment with the system's variables replacing or adding to it
+static const char **build_envp(const Launch *launch)
+{
+    int count = 0;
+    while (environ[count])
+        count++;
+
+    const char **envp = malloc((count + launch->env_count + 1) * sizeof(*envp));
+    if (!envp)
+        return NULL;
+
+    int n = 0;
+    for (int i = 0; i < count; i++)
+    {
+        bool replaced = false;
+        for (int j = 0; j < launch->env_count && !replaced; j++)
+        {
+            size_t len = strchr(launch->env[j], '=') - launch->env[j] + 1;
+            replaced = strncmp(environ[i], launch->env[j], len) == 0;
+        }
+        if (!replaced)
+            envp[n++] = environ[i];
+    }
+    for (int j = 0; j < launch->env_count; j++)
+        envp[n++] = launch->env[j];
+    envp[n] = NULL;
+    return envp;
+}
+
+static bool resolve(Launch *launch)
+{
+    if (!launch->binary[0])
+    {
+        fprintf(stderr, "System [%s] has no binary\n", launch->short_name);
+        return false;
+    }
+    if (!launch->name[0])
+        snprintf(launch->name, sizeof(launch->name), "%s", launch->short_name);
+    if (!launch->profile[0])
+        snprintf(launch->profile, sizeof(launch->profile), "%s", launch->short_name);
+
+    const char *base = strrchr(launch->binary, '/');
+    launch->argv[0] = base ? base + 1 : launch->binary;
+    launch->argc = 1;
+    launch->rom_arg = -1;
+    char *save;
+    for (char *tok = strtok_r(launch->args, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save))
+    {
+        if (launch->argc >= LAUNCH_MAX_ARGS)
+        {
+            fprintf(stderr, "Too many args for %s\n", launch->short_name);
+            break;
+        }
+        if (strcmp(tok, LAUNCH_ROM_TOKEN) == 0)
+            launch->rom_arg = launch->argc;
+        launch->argv[launch->argc++] = tok;
+    }
+    launch->argv[launch->argc] = NULL;
+
+    int exts = 0;
+    for (char *tok = strtok_r(launch->extensions, " \t,", &save); tok && exts < LAUNCH_MAX_EXTS;
+         tok = strtok_r(NULL, " \t,", &save))
+        launch->exts[exts++] = tok;
+    launch->exts[exts] = NULL;
+
+    launch->prefetch[0] = launch->binary;
+    for (int i = 0; i < launch->prefetch_count; i++)
+        launch->prefetch[i + 1] = launch->prefetch_paths[i];
+    launch->prefetch[launch->prefetch_count + 1] = NULL;
+
+    launch->envp = build_envp(launch);
+    return launch->envp != NULL;
+}
+
+// Call once the launcher's own environment is final, emulators inherit it
+int launch_load_systems(System *systems, int max)
+{
+    launch_count = 0;
+    load_file(LAUNCH_SYSTEM_PATH);
+    load_file(LAUNCH_USER_PATH);
+
+    int count = 0;
+    for (int i = 0; i < launch_count && count < max; i++)
+    {
+        Launch *launch = &launches[i];
+        if (!resolve(launch))
+            continue;
+
+        System *sys = &systems[count++];
+        memset(sys, 0, sizeof(*sys));
+        sys->name = launch->name;
+        sys->short_name = launch->short_name;
+        sys->extensions = launch->exts;
+        sys->launch = launch;
+    }
+
+    if (count == 0)
+        fprintf(stderr, "No systems configured in %s\n", LAUNCH_SYSTEM_PATH);
+    return count;
+}
+
+// Runs in the forked child. Profile arguments go right after argv[0] since
+// some emulators want the ROM last. Only returns if exec failed.
+void launch_exec(const Launch *launch, const char *rom, const Profile *profile)
+{
+    char extra[sizeof(profile->args)];
+    const char *argv[LAUNCH_MAX_ARGS * 2 + 2];
+    int argc = 0;
+    int max_extra = LAUNCH_MAX_ARGS;
+
+    argv[argc++] = launch->argv[0];
+    snprintf(extra, sizeof(extra), "%s", profile->args);
+    for (char *tok = strtok(extra, " \t"); tok && max_extra-- > 0; tok = strtok(NULL, " \t"))
+        argv[argc++] = tok;
+    for (int i = 1; i < launch->argc; i++)
+        argv[argc++] = (i == launch->rom_arg) ? rom : launch->argv[i];
+    if (launch->rom_arg < 0)
+        argv[argc++] = rom;
+    argv[argc] = NULL;
+
+    execve(launch->binary, (char *const *)argv, (char *const *)launch->envp);
+}
+
+// Same as launch_exec() with the bench_args template, for the regression
+// benchmark only, so it's tokenized here rather than up front
+void launch_exec_bench(const Launch *launch, const char *rom, const char *frames, const Profile *profile)
+{
+    char extra[sizeof(profile->args)];
+    char args[sizeof(launch->bench_args)];
+    const char *argv[LAUNCH_MAX_ARGS * 2 + 2];
+    int argc = 0;
+    int max_extra = LAUNCH_MAX_ARGS;
+
+    argv[argc++] = launch->argv[0];
+    snprintf(extra, sizeof(extra), "%s", profile->args);
+    for (char *tok = strtok(extra, " \t"); tok && max_extra-- > 0; tok = strtok(NULL, " \t"))
+        argv[argc++] = tok;
+    // %frames can be part of an argument (--bench=%frames), %rom is one on its own
+    size_t len = 0;
+    for (const char *c = launch->bench_args; *c && len < sizeof(args) - 1; )
+    {
+        if (strncmp(c, LAUNCH_FRAMES_TOKEN, strlen(LAUNCH_FRAMES_TOKEN)) == 0)
+        {
+            len += snprintf(args + len, sizeof(args) - len, "%s", frames);
+            c += strlen(LAUNCH_FRAMES_TOKEN);
+        }
+        else
+            args[len++] = *c++;
+    }
+    args[len < sizeof(args) ? len : sizeof(args) - 1] = '\0';
+
+    int max_args = LAUNCH_MAX_ARGS;
+    for (char *tok = strtok(args, " \t"); tok && max_args-- > 0; tok = strtok(NULL, " \t"))
+        argv[argc++] = strcmp(tok, LAUNCH_ROM_TOKEN) == 0 ? rom : tok;
+    argv[argc] = NULL;
+
+    execve(launch->binary, (char *const *)argv, (char *const *)launch->envp);
+}
+
+// Blocks until the hook is done, it runs before the menu comes back
+void launch_post_exit(const Launch *launch)
+{
+    if (!launch->post_exit[0])
+        return;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execle("/bin/sh", "sh", "-c", launch->post_exit, (char *)NULL, (char *const *)launch->envp);
+        _exit(127);
+    }
+    if (pid < 0)
+    {
+        fprintf(stderr, "Could not run post_exit for %s: %s\n", launch->short_name, strerror(errno));
+        return;
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fprintf(stderr, "post_exit for %s failed\n", launch->short_name);
+}
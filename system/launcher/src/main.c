@@ -1,11 +1,14 @@
-#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
 
 #include <sys/wait.h>
+#include <sys/syscall.h>
 #include <errno.h>
+#include <poll.h>
 #include <SDL2/SDL.h>
-#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_syswm.h>
 
 #include "font_data.h"
+#include "font_atlas.h"
 #include "shared.h"
 
 // Display
@@ -13,26 +16,8 @@
 #define SCREEN_HEIGHT 480
 
 // Menu
-#define MAX_SYSTEMS 5
-#define MAX_GAMES 256
 #define BATTERY_READ_MS 1750
 
-typedef struct
-{
-    char name[256];
-    char path[512];
-} Game;
-
-typedef struct
-{
-    const char *name;
-    const char *short_name;
-    const char *emulator;
-    const char **extensions;
-    Game games[MAX_GAMES];
-    int game_count;
-} System;
-
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
 static SDL_GameController *gamepad = NULL;
@@ -46,172 +31,44 @@ static int battery_capacity = -1;
 static bool battery_charging = false;
 static Uint32 battery_last_read  = 0;
 
-static const char *n64_exts[] = {".z64", ".n64", ".v64", NULL};
-static const char *stn_exts[] = {".chd", ".iso", ".cue", NULL};
-static const char *dc_exts[] = {".gdi", ".cdi", ".chd", NULL};
-static const char *ps1_exts[] = {".cue", ".chd", ".pbp", NULL};
-static const char *psp_exts[] = {".iso", ".cso", ".chd", NULL};
-
-static System systems[MAX_SYSTEMS] = {
-    {"Nintendo 64", "n64", "mupen64plus", n64_exts, {}, 0},
-    {"Saturn", "stn", "yabasanshiro", stn_exts, {}, 0},
-    {"Dreamcast", "dc", "flycast", dc_exts, {}, 0},
-    {"PlayStation", "ps1", "pcsx", ps1_exts, {}, 0},
-    {"PS Portable", "psp", "PPSSPPSDL", psp_exts, {}, 0}};
-
-static bool has_extension(const char *filename, const char **extensions)
-{
-    if (!filename || !extensions)
-        return false;
-
-    const char *dot = strrchr(filename, '.');
-    if (!dot)
-        return false;
-
-    for (int i = 0; extensions[i]; i++)
-    {
-        if (strcasecmp(dot, extensions[i]) == 0)
-            return true;
-    }
-    return false;
-}
-
-static void set_cpu_governor(const char *cpu_gov)
-{
-    if (cpu_gov) {
-        bool result = false;
-        for (int cpu = 0; cpu < 4; cpu++) {
-            char path[256];
-            snprintf(path, sizeof(path),
-                "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
-
-            FILE *fp = fopen(path, "w");
-            if (fp) {
-                fprintf(fp, "%s\n", cpu_gov);
-                fclose(fp);
-                result = true;
-            } else if (cpu == 0) {
-                fprintf(stderr, "Could not set CPU governor: %s\n", strerror(errno));
-                break;
-            }
-        }
-        if (result)
-            printf("Set CPU governor to: %s\n", cpu_gov);
-    }
-}
-
-static void set_gpu_governor(const char *gpu_gov)
-{
-    if (gpu_gov)
-    {
-        const char *gpu_path = "/sys/class/devfreq/fde60000.gpu/governor";
-        FILE *fp = fopen(gpu_path, "w");
-        if (fp)
-        {
-            fprintf(fp, "%s\n", gpu_gov);
-            fclose(fp);
-            printf("Set GPU governor to: %s\n", gpu_gov);
-            return;
-        }
-        fprintf(stderr, "Could not set GPU governor.\n");
-    }
-}
-
-static int compare_games(const void *a, const void *b)
-{
-    const Game *game_a = (const Game *)a;
-    const Game *game_b = (const Game *)b;
-    return strcasecmp(game_a->name, game_b->name);
-}
-
-static void scan_games(System *system)
-{
-    DIR *dir;
-    struct dirent *entry;
-    system->game_count = 0;
-
-    const char *base_dirs[] = {"/mnt/games", "/mnt/games2"};
-
-    // Scan each base directory
-    for (int d = 0; d < 2; d++)
-    {
-        char rom_dir[32];
-        snprintf(rom_dir, sizeof(rom_dir), "%s/%s", base_dirs[d], system->short_name);
-
-        dir = opendir(rom_dir);
-        if (!dir)
-            continue;
-
-        while ((entry = readdir(dir)) != NULL && system->game_count < MAX_GAMES)
-        {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-                continue;
+// Filled from systems.ini at startup
+static System systems[MAX_SYSTEMS];
+static int system_count = 0;
 
-            // Only skip directories, regular files may be DT_UNKNOWN
-            if (entry->d_type == DT_DIR)
-                continue;
+// Glyph batching: every string drawn in a frame is queued as textured quads
+// with per-vertex colour and submitted in a single SDL_RenderGeometry call
+#define TEXT_BATCH_MAX_GLYPHS 1024
+#define TEXT_CACHE_MAX_CHARS 63
+#define FONT_ATLAS_WIDTH  (FONT_ATLAS_COLS * FONT_CHAR_WIDTH)
+#define FONT_ATLAS_HEIGHT (FONT_ATLAS_ROWS * FONT_CHAR_HEIGHT)
 
-            if (has_extension(entry->d_name, system->extensions))
-            {
-                Game *game = &system->games[system->game_count];
-
-                // Copy filename without extension as game name
-                strncpy(game->name, entry->d_name, sizeof(game->name) - 2);
-                char *dot = strrchr(game->name, '.');
-                if (dot)
-                    *dot = '\0';
-
-                // Remove parenthesized, bracketed, and braced annotations (e.g. "(USA)", "[!]", "{v1.0}")
-                static const char open_brackets[]  = "([{";
-                static const char close_brackets[] = ")]}";
-                for (int b = 0; b < 3; b++) {
-                    char *open = game->name;
-                    while ((open = strchr(open, open_brackets[b])) != NULL) {
-                        char *close = strchr(open, close_brackets[b]);
-                        if (!close) break;
-                        memmove(open, close + 1, strlen(close + 1) + 1);
-                    }
-                }
-                // Trim trailing whitespace left behind
-                char *end = game->name + strlen(game->name) - 1;
-                while (end > game->name && *end == ' ')
-                    *end-- = '\0';
+static SDL_Vertex text_vertices[TEXT_BATCH_MAX_GLYPHS * 4];
+static int text_indices[TEXT_BATCH_MAX_GLYPHS * 6];
+static int text_glyph_count = 0;
 
-                // Full path
-                snprintf(game->path, sizeof(game->path), "%s/%s",
-                         rom_dir, entry->d_name);
-
-                system->game_count++;
-            }
-        }
-        closedir(dir);
-    }
-
-    // Sort games alphabetically by name
-    if (system->game_count > 0)
-        qsort(system->games, system->game_count, sizeof(Game), compare_games);
-
-    printf("Found %d games for %s\n", system->game_count, system->name);
-}
+// Coverage bytes generated from assets/font.png at build time
+_Static_assert(FONT_ATLAS_DATA_WIDTH == FONT_ATLAS_WIDTH &&
+               FONT_ATLAS_DATA_HEIGHT == FONT_ATLAS_HEIGHT,
+               "font.png doesn't match the geometry in font_data.h");
 
 static bool load_font(void)
 {
-    int img_flags = IMG_INIT_PNG;
-    if (!(IMG_Init(img_flags) & img_flags))
-    {
-        fprintf(stderr, "SDL_image init failed: %s\n", IMG_GetError());
+    // Opaque grey on black, drawn exactly like the decoded PNG used to be
+    Uint32 *pixels = malloc(sizeof(Uint32) * FONT_ATLAS_WIDTH * FONT_ATLAS_HEIGHT);
+    if (!pixels)
         return false;
-    }
+    for (int i = 0; i < FONT_ATLAS_WIDTH * FONT_ATLAS_HEIGHT; i++)
+        pixels[i] = font_atlas_data[i] * 0x010101u;
 
-    SDL_Surface *font_surface = IMG_Load("/usr/share/mimiki/assets/font.png");
-    if (!font_surface)
+    font_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STATIC,
+                                     FONT_ATLAS_WIDTH, FONT_ATLAS_HEIGHT);
+    if (font_texture &&
+        SDL_UpdateTexture(font_texture, NULL, pixels, FONT_ATLAS_WIDTH * sizeof(Uint32)) != 0)
     {
-        fprintf(stderr, "Failed to load font.png: %s\n", IMG_GetError());
-        return false;
+        SDL_DestroyTexture(font_texture);
+        font_texture = NULL;
     }
-
-    font_texture = SDL_CreateTextureFromSurface(renderer, font_surface);
-    SDL_FreeSurface(font_surface);
+    free(pixels);
 
     if (!font_texture)
     {
@@ -219,13 +76,22 @@ static bool load_font(void)
         return false;
     }
 
+    // Two triangles per glyph quad, shared by every batch
+    for (int i = 0; i < TEXT_BATCH_MAX_GLYPHS; i++)
+    {
+        int *idx = &text_indices[i * 6];
+        int base = i * 4;
+        idx[0] = base;     idx[1] = base + 1; idx[2] = base + 2;
+        idx[3] = base + 2; idx[4] = base + 3; idx[5] = base;
+    }
+    text_glyph_count = 0;
+
     printf("Bitmap font loaded successfully\n");
     return true;
 }
 
 static bool init_sdl(void)
 {
-    setenv("SDL_VIDEODRIVER", "kmsdrm", 1);
     while (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER) < 0)
     {
         usleep(250000);
@@ -254,7 +120,12 @@ static bool init_sdl(void)
         return false;
     }
 
-    if (!load_font())
+    thumbs_attach(renderer);
+
+    uint64_t font_start = trace_now();
+    bool font_ok = load_font();
+    trace_span("load_font", font_start);
+    if (!font_ok)
     {
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
@@ -275,12 +146,22 @@ static bool init_sdl(void)
         }
     }
 
+    // SDL's DRM device is kept across games, only master is handed over
+    SDL_SysWMinfo wm;
+    SDL_VERSION(&wm.version);
+    if (SDL_GetWindowWMInfo(window, &wm) && wm.subsystem == SDL_SYSWM_KMSDRM)
+        display_attach(wm.info.kmsdrm.drm_fd);
+    else
+        display_attach(-1);
+
     printf("SDL2 initialized successfully (KMS/DRM backend)\n");
     return true;
 }
 
 static void cleanup_sdl(void)
 {
+    display_attach(-1);
+    thumbs_attach(NULL);
     if (gamepad)
     {
         SDL_GameControllerClose(gamepad);
@@ -301,21 +182,31 @@ static void cleanup_sdl(void)
         SDL_DestroyWindow(window);
         window = NULL;
     }
-    IMG_Quit();
     SDL_Quit();
 }
 
-static void draw_text_rgb(int x, int y, const char *text, Uint8 r, Uint8 g, Uint8 b)
+// Pre-built geometry for strings that rarely change (titles, instructions, page info)
+typedef struct
 {
-    if (!text || !font_texture)
-        return;
-
-    SDL_SetTextureColorMod(font_texture, r, g, b);
-
+    bool valid;
+    char text[TEXT_CACHE_MAX_CHARS + 1];
+    int x, y;
+    Uint8 r, g, b;
+    int glyph_count;
+    SDL_Vertex vertices[TEXT_CACHE_MAX_CHARS * 4];
+} TextCache;
+
+static TextCache system_title_text, system_help_text;
+static TextCache game_title_text, game_help_text, game_back_text, game_page_text;
+
+static int build_glyphs(SDL_Vertex *out, int max_glyphs, int x, int y, const char *text,
+                        Uint8 r, Uint8 g, Uint8 b)
+{
+    SDL_Color color = {r, g, b, 255};
+    int count = 0;
     int cursor_x = x;
-    int cursor_y = y;
 
-    for (const char *c = text; *c != '\0'; c++)
+    for (const char *c = text; *c != '\0' && count < max_glyphs; c++)
     {
         unsigned char ch = (unsigned char)*c;
 
@@ -328,18 +219,61 @@ static void draw_text_rgb(int x, int y, const char *text, Uint8 r, Uint8 g, Uint
 
         // Calculate position in atlas
         int char_index = ch - FONT_FIRST_CHAR;
-        int atlas_x = (char_index % FONT_ATLAS_COLS) * FONT_CHAR_WIDTH;
-        int atlas_y = (char_index / FONT_ATLAS_COLS) * FONT_CHAR_HEIGHT;
-
-        SDL_Rect src_rect = {atlas_x, atlas_y, FONT_CHAR_WIDTH, FONT_CHAR_HEIGHT};
-        SDL_Rect dst_rect = {cursor_x, cursor_y, FONT_CHAR_WIDTH, FONT_CHAR_HEIGHT};
-
-        SDL_RenderCopy(renderer, font_texture, &src_rect, &dst_rect);
+        float u0 = (float)((char_index % FONT_ATLAS_COLS) * FONT_CHAR_WIDTH) / FONT_ATLAS_WIDTH;
+        float v0 = (float)((char_index / FONT_ATLAS_COLS) * FONT_CHAR_HEIGHT) / FONT_ATLAS_HEIGHT;
+        float u1 = u0 + (float)FONT_CHAR_WIDTH / FONT_ATLAS_WIDTH;
+        float v1 = v0 + (float)FONT_CHAR_HEIGHT / FONT_ATLAS_HEIGHT;
+        float x0 = cursor_x, y0 = y;
+        float x1 = x0 + FONT_CHAR_WIDTH, y1 = y0 + FONT_CHAR_HEIGHT;
+
+        SDL_Vertex *v = &out[count * 4];
+        v[0] = (SDL_Vertex){{x0, y0}, color, {u0, v0}};
+        v[1] = (SDL_Vertex){{x1, y0}, color, {u1, v0}};
+        v[2] = (SDL_Vertex){{x1, y1}, color, {u1, v1}};
+        v[3] = (SDL_Vertex){{x0, y1}, color, {u0, v1}};
+        count++;
 
         cursor_x += FONT_CHAR_WIDTH;
     }
+    return count;
+}
+
+static void flush_text(void)
+{
+    if (text_glyph_count > 0 && font_texture)
+        SDL_RenderGeometry(renderer, font_texture, text_vertices, text_glyph_count * 4,
+                           text_indices, text_glyph_count * 6);
+    text_glyph_count = 0;
+}
 
-    SDL_SetTextureColorMod(font_texture, 255, 255, 255);
+static void present_frame(void)
+{
+    flush_text();
+    SDL_RenderPresent(renderer);
+}
+
+static void queue_glyphs(const SDL_Vertex *vertices, int glyph_count)
+{
+    if (text_glyph_count + glyph_count > TEXT_BATCH_MAX_GLYPHS)
+        flush_text();
+    if (glyph_count > TEXT_BATCH_MAX_GLYPHS)
+        glyph_count = TEXT_BATCH_MAX_GLYPHS;
+
+    memcpy(&text_vertices[text_glyph_count * 4], vertices, glyph_count * 4 * sizeof(SDL_Vertex));
+    text_glyph_count += glyph_count;
+}
+
+static void draw_text_rgb(int x, int y, const char *text, Uint8 r, Uint8 g, Uint8 b)
+{
+    if (!text || !font_texture)
+        return;
+
+    int len = (int)strlen(text);
+    if (text_glyph_count + len > TEXT_BATCH_MAX_GLYPHS)
+        flush_text();
+
+    text_glyph_count += build_glyphs(&text_vertices[text_glyph_count * 4],
+                                     TEXT_BATCH_MAX_GLYPHS - text_glyph_count, x, y, text, r, g, b);
 }
 
 static void draw_text(int x, int y, const char *text, bool selected)
@@ -350,65 +284,64 @@ static void draw_text(int x, int y, const char *text, bool selected)
         draw_text_rgb(x, y, text, 255, 255, 255);
 }
 
-static char batt_cap_path[80]  = "";
-static char batt_stat_path[80] = "";
-
-static bool find_battery_supply(void)
+// Same as draw_text, but the quads are only rebuilt when the string, position or colour changes
+static void draw_text_cached(TextCache *cache, int x, int y, const char *text, bool selected)
 {
-    DIR *dir = opendir("/sys/class/power_supply");
-    if (!dir)
-        return false;
+    if (!text || !font_texture)
+        return;
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL)
+    Uint8 r = selected ? 100 : 255, g = 255, b = selected ? 100 : 255;
+    if (!cache->valid || cache->x != x || cache->y != y || cache->r != r ||
+        cache->g != g || cache->b != b || strcmp(cache->text, text) != 0)
     {
-        if (entry->d_name[0] == '.')
-            continue;
-
-        char type_path[96];
-        snprintf(type_path, sizeof(type_path),
-                 "/sys/class/power_supply/%s/type", entry->d_name);
+        snprintf(cache->text, sizeof(cache->text), "%s", text);
+        cache->x = x;
+        cache->y = y;
+        cache->r = r;
+        cache->g = g;
+        cache->b = b;
+        cache->glyph_count = build_glyphs(cache->vertices, TEXT_CACHE_MAX_CHARS, x, y, cache->text, r, g, b);
+        cache->valid = true;
+    }
 
-        FILE *fp = fopen(type_path, "r");
-        if (!fp)
-            continue;
+    queue_glyphs(cache->vertices, cache->glyph_count);
+}
 
-        char type[32] = {0};
-        fgets(type, sizeof(type), fp);
-        fclose(fp);
+static char batt_cap_path[80]  = "";
+static char batt_stat_path[80] = "";
 
-        if (strncmp(type, "Battery", 7) == 0)
-        {
-            snprintf(batt_cap_path, sizeof(batt_cap_path),
-                     "/sys/class/power_supply/%s/capacity", entry->d_name);
-            snprintf(batt_stat_path, sizeof(batt_stat_path),
-                     "/sys/class/power_supply/%s/status", entry->d_name);
-            printf("Battery supply found: %s\n", entry->d_name);
-            closedir(dir);
-            return true;
-        }
-    }
+static bool find_battery_supply(void)
+{
+    char dir[64];
+    if (!control_find_battery(dir, sizeof(dir)))
+        return false;
 
-    closedir(dir);
-    return false;
+    snprintf(batt_cap_path, sizeof(batt_cap_path), "%s/capacity", dir);
+    snprintf(batt_stat_path, sizeof(batt_stat_path), "%s/status", dir);
+    printf("Battery supply found: %s\n", dir);
+    return true;
 }
 
-static void read_battery(void)
+// Returns true when the displayed battery state changed
+static bool read_battery(void)
 {
     if (batt_cap_path[0] == '\0')
     {
         if (!find_battery_supply())
         {
             battery_capacity = -1;
-            return;
+            return false;
         }
     }
 
     Uint32 now = SDL_GetTicks();
     if (battery_capacity >= 0 && (now - battery_last_read) < BATTERY_READ_MS)
-        return;
+        return false;
     battery_last_read = now;
 
+    int old_capacity = battery_capacity;
+    bool old_charging = battery_charging;
+
     FILE *fp = fopen(batt_cap_path, "r");
     if (fp) {
         if (fscanf(fp, "%d", &battery_capacity) != 1)
@@ -425,13 +358,14 @@ static void read_battery(void)
     } else {
         battery_charging = false;
     }
+
+    return battery_capacity != old_capacity || battery_charging != old_charging;
 }
 
 // Battery indicator
 // Thresholds: 4=100-75%, 3=74-50%, 2=49-25%, 1=24-10%, 0=9-0% (red)
 static void draw_battery(int x, int y)
 {
-    read_battery();
     if (battery_capacity < 0)
         return;
 
@@ -476,14 +410,14 @@ static void render_system_menu(void)
     SDL_RenderClear(renderer);
 
     // Title
-    draw_text(272, 40, "MIMIKI", false);
+    draw_text_cached(&system_title_text, 272, 40, "MIMIKI", false);
 
     // Battery indicator
     draw_battery(498, 40);
 
     // System list
     int y = 120;
-    for (int i = 0; i < MAX_SYSTEMS; i++)
+    for (int i = 0; i < system_count; i++)
     {
         bool selected = (i == current_system);
 
@@ -493,26 +427,177 @@ static void render_system_menu(void)
 
         draw_text(110, y, systems[i].name, selected);
 
-        // Game count
+        // Game count, marked while the scan is still filling it in
         char count[32];
-        snprintf(count, sizeof(count), "(%d games)", systems[i].game_count);
+        snprintf(count, sizeof(count), scanner_system_done(i) ? "(%d games)" : "(%d games...)",
+                 systems[i].catalog.count);
         draw_text(380, y, count, false);
 
         y += 50;
     }
 
     // Instructions
-    draw_text(120, 396, "D-PAD: Navigate  A: Select", false);
+    draw_text_cached(&system_help_text, 120, 396, "D-PAD: Navigate  A: Select", false);
 
-    SDL_RenderPresent(renderer);
+    present_frame();
 }
 
 // Max characters that fit in the game name column (x=110 to x=630, 16px/char)
 #define GAME_NAME_MAX_CHARS 27
+#define GAMES_PER_PAGE      10
+// Artwork of the highlighted game, right of the name column
+#define THUMB_X 552
+#define THUMB_Y 80
 
 static int   scroll_offset     = 0;
 static int   last_scrolled_game = -1;
 static Uint32 scroll_last_ms   = 0;
+static char  staged_path[PATH_MAX] = ""; // Game last handed to prefetch_game()
+static int   thumbs_page = -1;             // First game of the page whose artwork was last requested
+
+// Prefix search over the lowercased names. While a prefix is set the list
+// only shows [match_lo, match_hi), one contiguous run of the sorted catalog.
+#define SEARCH_MAX_CHARS 16
+#define SEARCH_CHARS     "abcdefghijklmnopqrstuvwxyz0123456789 "
+
+static char  search_prefix[SEARCH_MAX_CHARS + 1] = "";
+static int   search_len  = 0;
+static bool  search_editing = false;
+static int   match_lo = 0, match_hi = 0;
+
+// Games currently listed, the whole catalog unless a prefix is set
+static void list_range(const System *sys, int *lo, int *hi)
+{
+    *lo = search_len > 0 ? match_lo : 0;
+    *hi = search_len > 0 ? match_hi : sys->catalog.count;
+}
+
+static void clear_search(void)
+{
+    search_prefix[0] = '\0';
+    search_len = 0;
+    search_editing = false;
+}
+
+// A rescan can take every match away, the filter goes with them
+static void update_matches(const System *sys)
+{
+    if (search_len > 0)
+        catalog_prefix_range(&sys->catalog, search_prefix, &match_lo, &match_hi);
+    if (search_len > 0 && match_lo >= match_hi)
+        clear_search();
+}
+
+// Starts from the highlighted game's initial so the list doesn't jump
+static void begin_search(const System *sys)
+{
+    search_editing = true;
+    if (search_len > 0)
+        return;
+
+    char initial = catalog_key(&sys->catalog, current_game)[0];
+    if (!initial)
+        return;
+    search_prefix[0] = initial;
+    search_prefix[1] = '\0';
+    search_len = 1;
+    update_matches(sys);
+}
+
+// Cycles the last prefix character to the next (dir 1) or previous (dir -1)
+// one that still matches something
+static void cycle_search_char(const System *sys, int dir)
+{
+    const char *chars = SEARCH_CHARS;
+    int count = (int)strlen(chars);
+    char original = search_prefix[search_len - 1];
+    const char *at = strchr(chars, original);
+    int pos = at ? (int)(at - chars) : (dir > 0 ? -1 : count);
+
+    for (int step = 1; step <= count; step++)
+    {
+        int candidate = ((pos + dir * step) % count + count) % count;
+        int lo, hi;
+        search_prefix[search_len - 1] = chars[candidate];
+        catalog_prefix_range(&sys->catalog, search_prefix, &lo, &hi);
+        if (lo < hi)
+        {
+            match_lo = lo;
+            match_hi = hi;
+            current_game = lo;
+            return;
+        }
+    }
+    // Nothing else matches, keep what was there
+    search_prefix[search_len - 1] = original;
+}
+
+// Extends the prefix with the highlighted game's next character, so it always matches
+static void extend_search(const System *sys)
+{
+    const char *key = catalog_key(&sys->catalog, current_game);
+    if (search_len >= SEARCH_MAX_CHARS || (int)strlen(key) <= search_len)
+        return;
+
+    memcpy(search_prefix, key, search_len + 1);
+    search_len++;
+    search_prefix[search_len] = '\0';
+    update_matches(sys);
+    current_game = match_lo;
+}
+
+static void shorten_search(const System *sys)
+{
+    search_prefix[--search_len] = '\0';
+    if (search_len == 0)
+        clear_search();
+    update_matches(sys);
+}
+
+// Moves the highlight by delta within the listed games
+static void move_selection(const System *sys, int delta)
+{
+    int lo, hi;
+    list_range(sys, &lo, &hi);
+    if (lo >= hi)
+        return;
+    current_game += delta;
+    if (current_game < lo)
+        current_game = lo;
+    if (current_game > hi - 1)
+        current_game = hi - 1;
+}
+
+// Starts staging the highlighted game, once per highlight
+static void stage_selected_game(const System *sys)
+{
+    char path[PATH_MAX];
+    if (catalog_path(&sys->catalog, current_game, path, sizeof(path)) <= 0 ||
+        strcmp(path, staged_path) == 0)
+        return;
+
+    snprintf(staged_path, sizeof(staged_path), "%s", path);
+    prefetch_game(path);
+}
+
+// Requests artwork for the visible page, then the next one, once per page
+static void request_page_thumbs(const System *sys, int first, int end)
+{
+    if (first == thumbs_page)
+        return;
+    thumbs_page = first;
+
+    static char paths[THUMB_MAX_REQUEST][PATH_MAX];
+    const char *list[THUMB_MAX_REQUEST];
+    int count = 0;
+    for (int i = first; i < end && count < THUMB_MAX_REQUEST; i++)
+    {
+        catalog_art_path(&sys->catalog, i, paths[count], sizeof(paths[count]));
+        list[count] = paths[count];
+        count++;
+    }
+    thumbs_request(sys->short_name, list, count);
+}
 
 static void render_game_menu(void)
 {
@@ -524,11 +609,27 @@ static void render_game_menu(void)
     // Title
     int title_width = strlen(sys->name) * FONT_CHAR_WIDTH;
     int title_x = (SCREEN_WIDTH - title_width) / 2;
-    draw_text(title_x, 40, sys->name, false);
+    draw_text_cached(&game_title_text, title_x, 40, sys->name, false);
 
     // Battery indicator
     draw_battery(498, 40);
 
+    // Pages are counted from the first listed game
+    int games_per_page = GAMES_PER_PAGE;
+    int list_lo, list_hi;
+    list_range(sys, &list_lo, &list_hi);
+    int start_idx = list_lo + ((current_game - list_lo) / games_per_page) * games_per_page;
+
+    if (list_lo < list_hi)
+    {
+        stage_selected_game(sys);
+        request_page_thumbs(sys, start_idx, list_hi);
+
+        char art[PATH_MAX];
+        catalog_art_path(&sys->catalog, current_game, art, sizeof(art));
+        thumbs_draw(art, THUMB_X, THUMB_Y);
+    }
+
     // Advance scroll state for the selected game
     Uint32 now = SDL_GetTicks();
     if (current_game != last_scrolled_game) {
@@ -536,7 +637,7 @@ static void render_game_menu(void)
         scroll_last_ms     = now;
         last_scrolled_game = current_game;
     } else if (now - scroll_last_ms >= 500) {
-        int name_len = (int)strlen(sys->games[current_game].name);
+        int name_len = (int)strlen(catalog_name(&sys->catalog, current_game));
         if (name_len > GAME_NAME_MAX_CHARS) {
             scroll_offset++;
             if (scroll_offset + GAME_NAME_MAX_CHARS > name_len)
@@ -546,14 +647,12 @@ static void render_game_menu(void)
     }
 
     // Game list
-    int games_per_page = 10;
-    int start_idx = (current_game / games_per_page) * games_per_page;
     int y = 80;
 
-    for (int i = start_idx; i < start_idx + games_per_page && i < sys->game_count; i++)
+    for (int i = start_idx; i < start_idx + games_per_page && i < list_hi; i++)
     {
         bool selected = (i == current_game);
-        const char *full_name = sys->games[i].name;
+        const char *full_name = catalog_name(&sys->catalog, i);
         int name_len = (int)strlen(full_name);
 
         // Build display name: scroll if selected & long, truncate otherwise
@@ -577,97 +676,258 @@ static void render_game_menu(void)
         y += 30;
     }
 
-    // Instructions
-    draw_text(120, 396, "D-PAD: Navigate  A: Launch", false);
-    draw_text(120, 420, "                 B:  Back", false);
+    // Instructions, or the prefix being searched for
+    if (search_len > 0)
+    {
+        char find[32];
+        snprintf(find, sizeof(find), search_editing ? "FIND: %s_" : "FIND: %s", search_prefix);
+        draw_text(120, 396, find, search_editing);
+    }
+    else
+    {
+        draw_text_cached(&game_help_text, 120, 396, "D-PAD: Navigate  A: Launch", false);
+    }
+    draw_text_cached(&game_back_text, 120, 420, "                 B:  Back", false);
 
     // Page indicator if needed
-    if (sys->game_count > games_per_page)
+    int listed = list_hi - list_lo;
+    if (listed > games_per_page)
     {
-        int current_page = (current_game / games_per_page) + 1;
-        int total_pages = (sys->game_count + games_per_page - 1) / games_per_page;
+        int current_page = ((current_game - list_lo) / games_per_page) + 1;
+        int total_pages = (listed + games_per_page - 1) / games_per_page;
         char page_info[32];
         snprintf(page_info, sizeof(page_info), "PAGE : %d/%d", current_page, total_pages);
-        draw_text(120, 420, page_info, false);
+        draw_text_cached(&game_page_text, 120, 420, page_info, false);
     }
 
-    SDL_RenderPresent(renderer);
+    present_frame();
 }
 
-static void launch_game(System *sys, Game *game)
-{
-    printf("Launching: %s (%s)\n", game->name, game->path);
-    cleanup_sdl();
+// Set when a game returns, cleared once the menu's first frame is up again
+static uint64_t menu_return_start = 0;
 
-    const char *cpu_gov = "schedutil";
-    const char *gpu_gov = "simple_ondemand";
+// Re-pin isolated emulator threads once a second while the game starts up, then rarely
+#define PIN_STARTUP_REPINS 15
+#define PIN_INTERVAL_MS    15000
+#define EXIT_TIMEOUT_MS    2000 // SIGTERM to SIGKILL
+#define RECLAIM_TIMEOUT_MS 1000
 
-    if (strcmp(sys->short_name, "n64") == 0)
-        gpu_gov = "performance";
-    
-    if (strcmp(sys->short_name, "stn") == 0)
-        cpu_gov = "performance";
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
 
-    set_cpu_governor(cpu_gov);
-    set_gpu_governor(gpu_gov);
+// Waits for the emulator to exit after SIGTERM, killing it if it hangs
+static void stop_child(pid_t pid, int *status)
+{
+    kill(pid, SIGTERM);
 
-    pid_t pid = fork();
-    if (pid == 0)
+    int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd >= 0)
     {
-        // Child process
-        if (strcmp(sys->short_name, "n64") == 0)
+        struct pollfd pfd = {.fd = pidfd, .events = POLLIN};
+        int ret;
+        while ((ret = poll(&pfd, 1, EXIT_TIMEOUT_MS)) < 0 && errno == EINTR)
+            ;
+        close(pidfd);
+        if (ret == 0)
         {
-            setenv("XDG_CACHE_HOME", "/mnt/games/data/.cache", 1);
-            execl("/usr/bin/mupen64plus", sys->emulator, game->path, (char *)NULL);
+            fprintf(stderr, "Emulator ignored SIGTERM, killing it\n");
+            kill(pid, SIGKILL);
         }
-        else if (strcmp(sys->short_name, "stn") == 0)
-        {
-            execl("/usr/bin/yabasanshiro", sys->emulator,
-                "-b", "/mnt/games/data/saturn_bios.bin", "-i", game->path, (char *)NULL);
-        }
-        else if (strcmp(sys->short_name, "dc") == 0)
-        {
-            execl("/usr/bin/flycast", sys->emulator, game->path, (char *)NULL);
-        }
-        else if (strcmp(sys->short_name, "ps1") == 0)
-        {
-            execl("/usr/bin/pcsx", sys->emulator, "-cdfile", game->path, (char *)NULL);
-        }
-        else if (strcmp(sys->short_name, "psp") == 0)
+    }
+    else
+    {
+        for (int waited = 0; waitpid(pid, status, WNOHANG) == 0; waited += 10)
         {
-            setenv("XDG_CONFIG_HOME", "/mnt/games/data", 1);
-            execl("/usr/bin/PPSSPPSDL", sys->emulator, game->path, (char *)NULL);
+            if (waited == EXIT_TIMEOUT_MS)
+                kill(pid, SIGKILL);
+            usleep(10000);
         }
+        return;
+    }
+    waitpid(pid, status, 0);
+}
+
+static void launch_game(System *sys, int index)
+{
+    char path[PATH_MAX];
+    catalog_path(&sys->catalog, index, path, sizeof(path));
+    printf("Launching: %s (%s)\n", catalog_name(&sys->catalog, index), path);
+    thumbs_cancel();
+    thumbs_page = -1;
+
+    uint64_t start = trace_now();
+    bool handoff = display_release();
+    if (handoff)
+    {
+        trace_span("release_display", start);
+    }
+    else
+    {
+        cleanup_sdl();
+        trace_span("cleanup_sdl", start);
+    }
+
+    Profile profile;
+    profile_load(&profile, sys->launch->profile, catalog_name(&sys->catalog, index),
+                 catalog_file(&sys->catalog, index));
+    profile_apply(&profile);
+
+    // Close-on-exec pipe: EOF once exec succeeded, an errno if it failed
+    int exec_pipe[2] = {-1, -1};
+    if (pipe2(exec_pipe, O_CLOEXEC) != 0)
+        fprintf(stderr, "Could not create exec pipe: %s\n", strerror(errno));
 
-        fprintf(stderr, "Failed to launch %s: %s\n", sys->emulator, strerror(errno));
+    start = trace_now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // Child process
+        if (exec_pipe[0] >= 0)
+            close(exec_pipe[0]);
+        profile_apply_child(&profile);
+
+        launch_exec(sys->launch, path, &profile);
+
+        int err = errno;
+        fprintf(stderr, "Failed to launch %s: %s\n", sys->launch->argv[0], strerror(err));
+        if (exec_pipe[1] >= 0)
+            write(exec_pipe[1], &err, sizeof(err));
+        _exit(127);
     }
     else if (pid > 0)
     {
-        // Parent process
+        if (exec_pipe[1] >= 0)
+        {
+            close(exec_pipe[1]);
+            int err;
+            while (read(exec_pipe[0], &err, sizeof(err)) < 0 && errno == EINTR)
+                ;
+            close(exec_pipe[0]);
+        }
+        trace_span("exec", start);
+        start = trace_now();
+
+        // Unpin the staged image, it stays in the page cache for the emulator
+        prefetch_game(NULL);
+        staged_path[0] = '\0';
+
+        // Parent process: sleep until a hotkey, the emulator exiting or a re-pin being due
         int status;
-        while (waitpid(pid, &status, WNOHANG) == 0)
+        if (!input_monitor_watch_start(pid))
         {
-            int hotkey = input_monitor_check_hotkeys();
-            if (hotkey == HOTKEY_EXIT_EMU || hotkey == HOTKEY_SHUTDOWN) {
-                kill(pid, SIGTERM);
-                usleep(250000); // Minor pause to let KMSDRM release itself
-                break;
+            fprintf(stderr, "Hotkeys unavailable for this session\n");
+            waitpid(pid, &status, 0);
+        }
+        else
+        {
+            int pins = 0;
+            uint64_t pin_due = profile.isolate_cpu >= 0 ? trace_now() + 1000000 : 0;
+            governor_start(&profile);
+            while (true)
+            {
+                int timeout = governor_timeout();
+                if (pin_due)
+                {
+                    uint64_t now = trace_now();
+                    int pin_timeout = now >= pin_due ? 0 : (int)((pin_due - now) / 1000);
+                    if (timeout < 0 || pin_timeout < timeout)
+                        timeout = pin_timeout;
+                }
+
+                bool exited = false;
+                int hotkey = input_monitor_watch_wait(timeout, &exited);
+                if (hotkey == HOTKEY_EXIT_EMU || hotkey == HOTKEY_SHUTDOWN) {
+                    stop_child(pid, &status);
+                    break;
+                }
+                if (exited)
+                {
+                    waitpid(pid, &status, 0);
+                    break;
+                }
+
+                // Pick up threads the emulator spawned since the last pass
+                if (pin_due && trace_now() >= pin_due)
+                {
+                    profile_pin_threads(&profile, pid);
+                    pins++;
+                    pin_due = trace_now() + ((pins < PIN_STARTUP_REPINS) ? 1000 : PIN_INTERVAL_MS) * 1000ull;
+                }
+                governor_poll();
             }
-            usleep(50000);
+            governor_stop();
+            input_monitor_watch_stop();
         }
 
+        trace_span("game", start);
         printf("Emulator exited\n");
+        launch_post_exit(sys->launch);
     }
     else
     {
         // Fork failed
         fprintf(stderr, "Fork failed\n");
+        if (exec_pipe[0] >= 0)
+        {
+            close(exec_pipe[0]);
+            close(exec_pipe[1]);
+        }
     }
 
-    init_sdl();
+    menu_return_start = trace_now();
+    if (handoff && display_reclaim(RECLAIM_TIMEOUT_MS))
+    {
+        // Input the emulator consumed is still queued for SDL
+        SDL_PumpEvents();
+        SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+        trace_span("reclaim_display", menu_return_start);
+    }
+    else
+    {
+        if (handoff)
+            cleanup_sdl();
+        init_sdl();
+        trace_span("init_sdl", menu_return_start);
+    }
+
+    profile_reset();
+}
 
-    set_cpu_governor("powersave");
-    set_gpu_governor("powersave");
+// While the prefix is being edited the D-pad types instead of scrolling
+static void handle_search_input(int button)
+{
+    System *sys = &systems[current_system];
+    thumbs_page = -1;
+
+    switch (button)
+    {
+    case SDL_CONTROLLER_BUTTON_DPAD_UP:
+        cycle_search_char(sys, -1);
+        break;
+
+    case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+        cycle_search_char(sys, 1);
+        break;
+
+    case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
+        extend_search(sys);
+        break;
+
+    case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+        shorten_search(sys);
+        break;
+
+    // Keep the filter and browse the matches
+    case SDL_CONTROLLER_BUTTON_B:
+    case SDL_CONTROLLER_BUTTON_BACK:
+        search_editing = false;
+        break;
+
+    case SDL_CONTROLLER_BUTTON_A:
+        clear_search();
+        break;
+    }
 }
 
 static void handle_input(SDL_Event *event)
@@ -676,6 +936,12 @@ static void handle_input(SDL_Event *event)
         exit(0);
 
     // Gamepad inputs
+    if (event->type == SDL_CONTROLLERBUTTONDOWN && in_game_list && search_editing)
+    {
+        handle_search_input(event->cbutton.button);
+        return;
+    }
+
     if (event->type == SDL_CONTROLLERBUTTONDOWN)
     {
         switch (event->cbutton.button)
@@ -683,8 +949,7 @@ static void handle_input(SDL_Event *event)
         case SDL_CONTROLLER_BUTTON_DPAD_UP:
             if (in_game_list)
             {
-                if (current_game > 0)
-                    current_game--;
+                move_selection(&systems[current_system], -1);
             }
             else
             {
@@ -696,13 +961,11 @@ static void handle_input(SDL_Event *event)
         case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
             if (in_game_list)
             {
-                System *sys = &systems[current_system];
-                if (current_game < sys->game_count - 1)
-                    current_game++;
+                move_selection(&systems[current_system], 1);
             }
             else
             {
-                if (current_system < MAX_SYSTEMS - 1)
+                if (current_system < system_count - 1)
                     current_system++;
             }
             break;
@@ -712,82 +975,296 @@ static void handle_input(SDL_Event *event)
             if (in_game_list)
             {
                 System *sys = &systems[current_system];
-                if (sys->game_count > 0)
-                    launch_game(sys, &sys->games[current_game]);
+                int lo, hi;
+                list_range(sys, &lo, &hi);
+                if (lo < hi)
+                    launch_game(sys, current_game);
             }
             else
             {
                 System *sys = &systems[current_system];
-                if (sys->game_count > 0)
+                if (sys->catalog.count > 0)
                 {
                     in_game_list = true;
                     current_game = 0;
+                    prefetch_system(sys->launch->prefetch);
                 }
             }
             break;
 
         // B Button on Device = South button (SDL A)
         case SDL_CONTROLLER_BUTTON_A:
-            if (in_game_list)
+            if (in_game_list && search_len > 0)
+            {
+                // Drop the filter first, the highlighted game stays put
+                clear_search();
+                thumbs_page = -1;
+            }
+            else if (in_game_list)
             {
                 in_game_list = false;
                 current_game = 0;
+                prefetch_game(NULL);
+                staged_path[0] = '\0';
+                thumbs_cancel();
+                thumbs_page = -1;
+            }
+            break;
+
+        // Page jumps on the shoulder buttons
+        case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:
+        case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER:
+            if (in_game_list)
+            {
+                bool forward = event->cbutton.button == SDL_CONTROLLER_BUTTON_RIGHTSHOULDER;
+                move_selection(&systems[current_system], forward ? GAMES_PER_PAGE : -GAMES_PER_PAGE);
+            }
+            break;
+
+        // Letter jumps, Y on Device = West button (SDL X), X = North (SDL Y)
+        case SDL_CONTROLLER_BUTTON_X:
+        case SDL_CONTROLLER_BUTTON_Y:
+            if (in_game_list && systems[current_system].catalog.count > 0)
+            {
+                System *sys = &systems[current_system];
+                int target = event->cbutton.button == SDL_CONTROLLER_BUTTON_Y
+                                 ? catalog_next_letter(&sys->catalog, current_game)
+                                 : catalog_prev_letter(&sys->catalog, current_game);
+                move_selection(sys, target - current_game);
+            }
+            break;
+
+        case SDL_CONTROLLER_BUTTON_BACK:
+            if (in_game_list && systems[current_system].catalog.count > 0)
+            {
+                begin_search(&systems[current_system]);
+                thumbs_page = -1;
             }
             break;
         }
     }
 }
 
-int main()
+// Merge finished scan results, keeping the highlighted game under the cursor.
+// Returns true when any visible count or list changed.
+static bool apply_scan_results(void)
+{
+    char selected_path[PATH_MAX] = "";
+    System *sys = &systems[current_system];
+    if (in_game_list && current_game < sys->catalog.count)
+        catalog_path(&sys->catalog, current_game, selected_path, sizeof(selected_path));
+
+    int changed = scanner_poll();
+    if (changed & (1 << current_system))
+    {
+        thumbs_page = -1;
+        update_matches(sys);
+    }
+    if (!in_game_list || !(changed & (1 << current_system)) || selected_path[0] == '\0')
+        return changed != 0;
+
+    char path[PATH_MAX];
+    for (int i = 0; i < sys->catalog.count; i++)
+    {
+        catalog_path(&sys->catalog, i, path, sizeof(path));
+        if (strcmp(path, selected_path) == 0)
+        {
+            current_game = i;
+            return true;
+        }
+    }
+    current_game = search_len > 0 ? match_lo : 0;
+    return true;
+}
+
+// Milliseconds until something on screen changes by itself, -1 if nothing will
+static int next_redraw_timeout(Uint32 now)
+{
+    int timeout = -1;
+
+    // Battery re-read, only redrawn if the reading actually changed
+    if (battery_capacity >= 0)
+    {
+        Uint32 due = battery_last_read + BATTERY_READ_MS;
+        timeout = SDL_TICKS_PASSED(now, due) ? 0 : (int)(due - now);
+    }
+
+    // Charging animation steps every 600 ms
+    if (battery_charging && battery_capacity >= 0 && battery_capacity < 95)
+    {
+        int step = 600 - (int)(now % 600);
+        if (timeout < 0 || step < timeout)
+            timeout = step;
+    }
+
+    // Marquee for the highlighted game name
+    if (in_game_list && current_game < systems[current_system].catalog.count &&
+        strlen(catalog_name(&systems[current_system].catalog, current_game)) > GAME_NAME_MAX_CHARS)
+    {
+        Uint32 due = scroll_last_ms + 500;
+        int step = SDL_TICKS_PASSED(now, due) ? 0 : (int)(due - now);
+        if (timeout < 0 || step < timeout)
+            timeout = step;
+    }
+
+    return timeout;
+}
+
+// A bench image's own benchmark, run once the boot stages are logged so the
+// emulator runs don't count as boot time. The scan finishes and the display
+// is handed back first, nothing else competes for the SoC while it runs.
+static void run_boot_benchmark(void)
+{
+    bool scanning = true;
+    while (scanning)
+    {
+        apply_scan_results();
+        scanning = false;
+        for (int i = 0; i < system_count; i++)
+            scanning = scanning || !scanner_system_done(i);
+
+        struct pollfd pfd = {.fd = scanner_fd(), .events = POLLIN};
+        if (scanning)
+            poll(&pfd, 1, 100);
+    }
+
+    thumbs_cancel();
+    thumbs_page = -1;
+    cleanup_sdl();
+    benchmark_run(NULL, systems, system_count); // Turns the backlight off
+    init_sdl();
+
+    // Back to the menu as it was, lit once it's on the panel
+    if (in_game_list)
+        render_game_menu();
+    else
+        render_system_menu();
+    SDL_Delay(50);
+    control_set_backlight(132);
+}
+
+int main(int argc, char **argv)
 {
     printf("MIMIKI Launcher - Starting...\n");
+    trace_mark("launcher_start");
+    bench_init();
+    bench_mark("launcher.start");
+
+    // Set before the launch environments are built, emulators need it too
+    setenv("SDL_VIDEODRIVER", "kmsdrm", 1);
+    system_count = launch_load_systems(systems, MAX_SYSTEMS);
+
+    // Regression benchmark, before the scan and SDL so nothing else competes for the SoC
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return benchmark_run(argc > 2 ? argv[2] : NULL, systems, system_count) > 0 ? 0 : 1;
+
+    // Scan in the background so it overlaps SDL bring-up and the first frames
+    scanner_start(systems, system_count);
 
+    uint64_t start = trace_now();
     if (!init_sdl())
         return 1;
+    trace_span("init_sdl", start);
+    bench_mark("launcher.init_sdl");
+
+    if (!control_init())
+        fprintf(stderr, "Warning: Some device controls unavailable\n");
 
     if (!input_monitor_init())
         fprintf(stderr, "Warning: Input monitoring unavailable\n");
 
-    for (int i = 0; i < MAX_SYSTEMS; i++)
-        scan_games(&systems[i]);
-
-    set_cpu_governor("powersave");
-    set_gpu_governor("powersave");
+    profile_reset();
     printf("Standing by...\n");
 
     SDL_Event event;
+    bool dirty = true;
+    Uint32 last_tick = SDL_GetTicks();
 
     while (true)
     { 
+        if (apply_scan_results())
+            dirty = true;
+
         while (SDL_PollEvent(&event))
+        {
             handle_input(&event);
+            dirty = true;
+        }
 
-        if (in_game_list)
-            render_game_menu();
-        else
-            render_system_menu();
+        if (read_battery())
+            dirty = true;
+
+        if (thumbs_poll() && in_game_list)
+            dirty = true;
+
+        // Timed redraws (marquee, charging animation) that came due while waiting
+        Uint32 now = SDL_GetTicks();
+        int timeout = next_redraw_timeout(last_tick);
+        if (timeout >= 0 && now - last_tick >= (Uint32)timeout)
+            dirty = true;
+
+        if (dirty)
+        {
+            start = trace_now();
+            if (in_game_list)
+                render_game_menu();
+            else
+                render_system_menu();
+            trace_span("frame", start);
+            dirty = false;
+            last_tick = SDL_GetTicks();
+
+            if (menu_return_start)
+            {
+                trace_span("exit_to_menu", menu_return_start);
+                menu_return_start = 0;
+                trace_dump();
+            }
+        }
 
         if (input_monitor_check_hotkeys() == HOTKEY_SHUTDOWN) {
             if (renderer) {
                 SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
                 SDL_RenderClear(renderer);
                 draw_text(460, 400, "mata ne!", false);
-                SDL_RenderPresent(renderer);
+                present_frame();
                 SDL_Delay(1000);
             }
             system("poweroff");
             break;
         }
 
-        SDL_Delay(50); // ~20 FPS is fine for a basic menu
-        if (!backlight_on) // First render should be done by now
+        if (!backlight_on) // Give the first frame a moment to reach the panel
         {
-            system("echo 132 > /sys/class/backlight/backlight/brightness");
+            start = trace_now();
+            SDL_Delay(50);
+            control_set_backlight(132);
             backlight_on = true;
+            trace_span("backlight_on", start);
+            trace_mark("first_frame");
+            trace_dump();
+            bench_mark("launcher.first_frame");
+            bench_flush();
+
+            if (benchmark_due())
+            {
+                run_boot_benchmark();
+                dirty = true;
+            }
         }
+
+        // Sleep until input, a scan result or the next timed redraw.
+        // The joypad evdev node is in the monitored set, so D-pad and
+        // button presses wake us straight away for SDL to pick up.
+        now = SDL_GetTicks();
+        timeout = next_redraw_timeout(now);
+        int wake_fds[] = {scanner_fd(), thumbs_fd()};
+        if (input_monitor_wait(timeout, wake_fds, 2) < 0)
+            SDL_WaitEventTimeout(NULL, timeout);
     }
 
     input_monitor_cleanup();
+    control_cleanup();
     cleanup_sdl();
     return 0;
 }
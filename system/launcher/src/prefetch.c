@@ -0,0 +1,343 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+// Warms the page cache with an emulator's binary, libraries and config while
+// the user is still browsing its game list. The rootfs is xz squashfs, so this
+// also moves the decompression off the launch path.
+//
+// The highlighted game is staged the same way: small images (N64 ROMs) are
+// read whole and locked in RAM until the emulator has started, large ones
+// only get their first few MB (headers, TOC, boot files). Moving the
+// highlight cancels the staging between chunks.
+#define PREFETCH_DIR_FILE_MAX (16 * 1024 * 1024) // Skip anything large found by directory walks
+
+#define PREFETCH_GAME_DELAY_MS 200                // Highlight dwell before any I/O
+#define PREFETCH_GAME_CHUNK    (1024 * 1024)
+#define PREFETCH_GAME_FULL_MAX (64 * 1024 * 1024) // Read and lock whole images up to this size
+#define PREFETCH_GAME_HEAD     (4 * 1024 * 1024)
+#define PREFETCH_SHEET_MAX     (64 * 1024)        // .cue/.gdi files listing the track files
+
+static pthread_mutex_t prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_cond = PTHREAD_COND_INITIALIZER;
+static const char *const *prefetch_pending = NULL; // A system's prefetch list, NULL terminated
+static bool prefetch_thread_started = false;
+
+static char game_path[PATH_MAX];           // Guarded by prefetch_lock
+static bool game_pending = false;          // Guarded by prefetch_lock
+static atomic_uint game_generation = 0;    // Bumped by every prefetch_game()
+static void *game_map = NULL;              // Guarded by prefetch_lock, the locked image
+static size_t game_map_size = 0;
+static char game_buffer[PREFETCH_GAME_CHUNK]; // Worker only
+
+static void prefetch_file(const char *path, off_t max_size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (max_size <= 0 || st.st_size <= max_size))
+        posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+static void prefetch_path(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return;
+
+    if (!S_ISDIR(st.st_mode))
+    {
+        prefetch_file(path, 0);
+        return;
+    }
+
+    DIR *dir = opendir(path);
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.' || entry->d_type == DT_DIR)
+            continue;
+
+        char file[PATH_MAX];
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        prefetch_file(file, PREFETCH_DIR_FILE_MAX);
+    }
+    closedir(dir);
+}
+
+static bool game_cancelled(unsigned generation)
+{
+    return atomic_load(&game_generation) != generation;
+}
+
+// Reads up to max_size bytes of path through the page cache, returns true if
+// the whole file was read
+static bool stage_file(const char *path, off_t max_size, unsigned generation)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return false;
+    }
+
+    off_t end = st.st_size < max_size ? st.st_size : max_size;
+    off_t offset = 0;
+    while (offset < end && !game_cancelled(generation))
+    {
+        size_t len = (end - offset) < PREFETCH_GAME_CHUNK ? (size_t)(end - offset) : PREFETCH_GAME_CHUNK;
+        ssize_t n = pread(fd, game_buffer, len, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        offset += n;
+    }
+    close(fd);
+    return offset == st.st_size;
+}
+
+// Keeps a fully staged image resident until the next prefetch_game() call
+static void lock_image(const char *path, unsigned generation)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return;
+
+    if (mlock(map, st.st_size) != 0)
+    {
+        munmap(map, st.st_size);
+        return;
+    }
+
+    pthread_mutex_lock(&prefetch_lock);
+    if (!game_cancelled(generation) && !game_map)
+    {
+        game_map = map;
+        game_map_size = st.st_size;
+        map = NULL;
+    }
+    pthread_mutex_unlock(&prefetch_lock);
+
+    if (map)
+        munmap(map, st.st_size);
+}
+
+// Stages the heads of the track files a .cue or .gdi sheet points at
+static void stage_sheet(const char *path, bool gdi, unsigned generation)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || st.st_size > PREFETCH_SHEET_MAX)
+        return;
+
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return;
+
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash)
+        *slash = '\0';
+    else
+        snprintf(dir, sizeof(dir), ".");
+
+    char line[PATH_MAX];
+    bool first = true;
+    while (fgets(line, sizeof(line), fp) && !game_cancelled(generation))
+    {
+        char name[PATH_MAX] = "";
+        if (gdi)
+        {
+            // "track lba type sector_size file offset", after a track count line
+            int pos = 0;
+            if (first || sscanf(line, "%*d %*d %*d %*d %n", &pos) < 0 || pos == 0)
+            {
+                first = false;
+                continue;
+            }
+            char *str = line + pos;
+            if (*str == '"')
+                sscanf(str + 1, "%[^\"]", name);
+            else
+                sscanf(str, "%s", name);
+        }
+        else
+        {
+            char *str = line;
+            while (isspace((unsigned char)*str))
+                str++;
+            if (strncasecmp(str, "FILE", 4) != 0)
+                continue;
+            str += 4;
+            while (isspace((unsigned char)*str))
+                str++;
+            if (*str == '"')
+                sscanf(str + 1, "%[^\"]", name);
+            else
+                sscanf(str, "%s", name);
+        }
+
+        if (name[0] == '\0')
+            continue;
+
+        char track[PATH_MAX * 2];
+        snprintf(track, sizeof(track), "%s/%s", dir, name);
+        stage_file(track, PREFETCH_GAME_HEAD, generation);
+    }
+    fclose(fp);
+}
+
+static void stage_game(const char *path, unsigned generation)
+{
+    // Don't touch the card while the user is still scrolling
+    for (int waited = 0; waited < PREFETCH_GAME_DELAY_MS; waited += 20)
+    {
+        if (game_cancelled(generation))
+            return;
+        usleep(20000);
+    }
+
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return;
+
+    const char *ext = strrchr(path, '.');
+    if (ext && (strcasecmp(ext, ".cue") == 0 || strcasecmp(ext, ".gdi") == 0))
+    {
+        stage_file(path, PREFETCH_SHEET_MAX, generation);
+        stage_sheet(path, strcasecmp(ext, ".gdi") == 0, generation);
+    }
+    else if (st.st_size <= PREFETCH_GAME_FULL_MAX)
+    {
+        if (stage_file(path, PREFETCH_GAME_FULL_MAX, generation))
+            lock_image(path, generation);
+    }
+    else
+    {
+        stage_file(path, PREFETCH_GAME_HEAD, generation);
+    }
+}
+
+static void *prefetch_worker(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&prefetch_lock);
+    while (true)
+    {
+        while (!prefetch_pending && !game_pending)
+            pthread_cond_wait(&prefetch_cond, &prefetch_lock);
+
+        // The emulator's own files first, they are needed whatever gets picked
+        if (prefetch_pending)
+        {
+            const char *const *paths = prefetch_pending;
+            prefetch_pending = NULL;
+            pthread_mutex_unlock(&prefetch_lock);
+
+            // Directories are walked one level deep
+            for (int i = 0; paths[i]; i++)
+                prefetch_path(paths[i]);
+
+            pthread_mutex_lock(&prefetch_lock);
+            continue;
+        }
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s", game_path);
+        unsigned generation = atomic_load(&game_generation);
+        game_pending = false;
+        pthread_mutex_unlock(&prefetch_lock);
+
+        stage_game(path, generation);
+
+        pthread_mutex_lock(&prefetch_lock);
+    }
+    return NULL;
+}
+
+// Called with prefetch_lock held
+static bool start_worker(void)
+{
+    if (prefetch_thread_started)
+        return true;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, prefetch_worker, NULL) != 0)
+    {
+        fprintf(stderr, "Could not start prefetch thread: %s\n", strerror(errno));
+        return false;
+    }
+    pthread_detach(thread);
+    prefetch_thread_started = true;
+    return true;
+}
+
+// paths outlives the request, the worker reads it after this returns
+void prefetch_system(const char *const *paths)
+{
+    if (!paths || !paths[0])
+        return;
+
+    pthread_mutex_lock(&prefetch_lock);
+    if (!start_worker())
+    {
+        pthread_mutex_unlock(&prefetch_lock);
+        return;
+    }
+
+    // Latest request wins. Re-walking a warm set is only a few cheap syscalls,
+    // and a game that just ran may well have pushed it out of the page cache.
+    prefetch_pending = paths;
+    pthread_cond_signal(&prefetch_cond);
+    pthread_mutex_unlock(&prefetch_lock);
+}
+
+// Stages the highlighted game, NULL just cancels and releases the last one
+void prefetch_game(const char *path)
+{
+    pthread_mutex_lock(&prefetch_lock);
+    atomic_fetch_add(&game_generation, 1);
+
+    void *map = game_map;
+    size_t map_size = game_map_size;
+    game_map = NULL;
+    game_map_size = 0;
+
+    game_pending = false;
+    if (path && path[0] && start_worker())
+    {
+        snprintf(game_path, sizeof(game_path), "%s", path);
+        game_pending = true;
+        pthread_cond_signal(&prefetch_cond);
+    }
+    pthread_mutex_unlock(&prefetch_lock);
+
+    // Unlocking only drops the pin, the pages stay in the page cache
+    if (map)
+        munmap(map, map_size);
+}
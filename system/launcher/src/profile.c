@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+// Performance profiles: [default], then [<system>], then [<system>:<game>],
+// each read from the shipped file first and the user's file second
+#define PROFILE_SYSTEM_PATH "/etc/mimiki/profiles.ini"
+#define PROFILE_USER_PATH   "/mnt/games/data/profiles.ini"
+
+#define NUM_CPUS 4
+#define GPU_DEVFREQ "/sys/class/devfreq/fde60000.gpu"
+
+static void profile_defaults(Profile *profile)
+{
+    memset(profile, 0, sizeof(*profile));
+    snprintf(profile->cpu_governor, sizeof(profile->cpu_governor), "schedutil");
+    snprintf(profile->gpu_governor, sizeof(profile->gpu_governor), "simple_ondemand");
+    profile->sched_policy = SCHED_OTHER;
+    profile->isolate_cpu = -1;
+}
+
+// "0-3", "1,3" or "0xe"
+static int parse_cpu_mask(const char *value)
+{
+    if (strncmp(value, "0x", 2) == 0)
+        return (int)strtol(value, NULL, 16) & ((1 << NUM_CPUS) - 1);
+
+    int mask = 0;
+    const char *p = value;
+    while (*p)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+            break;
+
+        long last = first;
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < NUM_CPUS; cpu++)
+        {
+            if (cpu >= 0)
+                mask |= 1 << cpu;
+        }
+
+        p = end;
+        while (*p == ',' || *p == ' ')
+            p++;
+    }
+    return mask;
+}
+
+static void apply_key(Profile *profile, const char *key, const char *value)
+{
+    if (strcmp(key, "cpu_governor") == 0)
+        snprintf(profile->cpu_governor, sizeof(profile->cpu_governor), "%s", value);
+    else if (strcmp(key, "gpu_governor") == 0)
+        snprintf(profile->gpu_governor, sizeof(profile->gpu_governor), "%s", value);
+    else if (strcmp(key, "cpu_min_freq") == 0)
+        profile->cpu_min_freq = atol(value);
+    else if (strcmp(key, "cpu_max_freq") == 0)
+        profile->cpu_max_freq = atol(value);
+    else if (strcmp(key, "gpu_min_freq") == 0)
+        profile->gpu_min_freq = atol(value);
+    else if (strcmp(key, "gpu_max_freq") == 0)
+        profile->gpu_max_freq = atol(value);
+    else if (strcmp(key, "cpu_affinity") == 0)
+        profile->cpu_affinity = parse_cpu_mask(value);
+    else if (strcmp(key, "nice") == 0)
+        profile->nice = atoi(value);
+    else if (strcmp(key, "sched_policy") == 0)
+    {
+        if (strcmp(value, "fifo") == 0)
+            profile->sched_policy = SCHED_FIFO;
+        else if (strcmp(value, "rr") == 0)
+            profile->sched_policy = SCHED_RR;
+        else
+            profile->sched_policy = SCHED_OTHER;
+    }
+    else if (strcmp(key, "sched_priority") == 0)
+        profile->sched_priority = atoi(value);
+    else if (strcmp(key, "isolate_cpu") == 0)
+        profile->isolate_cpu = (strcmp(value, "off") == 0) ? -1 : atoi(value);
+    else if (strcmp(key, "args") == 0)
+        snprintf(profile->args, sizeof(profile->args), "%s", value);
+    else
+        fprintf(stderr, "Unknown profile key: %s\n", key);
+}
+
+typedef struct
+{
+    const char *section;
+    Profile    *profile;
+    bool        found;
+} SectionLoad;
+
+static void load_key(void *ctx, const char *section, const char *key, const char *value)
+{
+    SectionLoad *load = ctx;
+    if (!section || strcasecmp(section, load->section) != 0)
+        return;
+
+    if (!key)
+        load->found = true;
+    else
+        apply_key(load->profile, key, value);
+}
+
+// Applies the keys of one exact section, returns true if it was found
+static bool load_section(const char *path, const char *section, Profile *profile)
+{
+    SectionLoad load = {section, profile, false};
+    ini_parse(path, load_key, &load);
+    return load.found;
+}
+
+void profile_load(Profile *profile, const char *system, const char *game_name, const char *game_file)
+{
+    static const char *paths[] = {PROFILE_SYSTEM_PATH, PROFILE_USER_PATH};
+    profile_defaults(profile);
+
+    for (int i = 0; i < 2; i++)
+        load_section(paths[i], "default", profile);
+
+    for (int i = 0; i < 2; i++)
+        load_section(paths[i], system, profile);
+
+    // Per-game sections match either the display name or the file name
+    if (game_name || game_file)
+    {
+        char section[PATH_MAX];
+        for (int i = 0; i < 2; i++)
+        {
+            bool found = false;
+            if (game_name)
+            {
+                snprintf(section, sizeof(section), "%s:%s", system, game_name);
+                found = load_section(paths[i], section, profile);
+            }
+            if (!found && game_file)
+            {
+                snprintf(section, sizeof(section), "%s:%s", system, game_file);
+                load_section(paths[i], section, profile);
+            }
+        }
+    }
+}
+
+static bool write_sysfs(const char *path, const char *value)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return false;
+
+    bool ok = fprintf(fp, "%s\n", value) > 0;
+    ok = (fclose(fp) == 0) && ok;
+    return ok;
+}
+
+static bool set_cpufreq_attr(const char *attr, const char *value)
+{
+    bool result = false;
+    for (int cpu = 0; cpu < NUM_CPUS; cpu++) {
+        char path[256];
+        snprintf(path, sizeof(path),
+            "/sys/devices/system/cpu/cpu%d/cpufreq/%s", cpu, attr);
+
+        if (write_sysfs(path, value)) {
+            result = true;
+        } else if (cpu == 0) {
+            fprintf(stderr, "Could not set CPU %s: %s\n", attr, strerror(errno));
+            break;
+        }
+    }
+    return result;
+}
+
+void set_cpu_governor(const char *cpu_gov)
+{
+    if (cpu_gov && cpu_gov[0] && set_cpufreq_attr("scaling_governor", cpu_gov))
+        printf("Set CPU governor to: %s\n", cpu_gov);
+}
+
+void set_gpu_governor(const char *gpu_gov)
+{
+    if (gpu_gov && gpu_gov[0])
+    {
+        if (write_sysfs(GPU_DEVFREQ "/governor", gpu_gov))
+        {
+            printf("Set GPU governor to: %s\n", gpu_gov);
+            return;
+        }
+        fprintf(stderr, "Could not set GPU governor.\n");
+    }
+}
+
+static void set_cpu_freq_range(long min_khz, long max_khz)
+{
+    char value[32];
+    // Raise the ceiling first so a higher floor is never rejected
+    if (max_khz > 0)
+    {
+        snprintf(value, sizeof(value), "%ld", max_khz);
+        set_cpufreq_attr("scaling_max_freq", value);
+    }
+    if (min_khz > 0)
+    {
+        snprintf(value, sizeof(value), "%ld", min_khz);
+        set_cpufreq_attr("scaling_min_freq", value);
+    }
+}
+
+static void set_gpu_freq_range(long min_hz, long max_hz)
+{
+    char value[32];
+    if (max_hz > 0)
+    {
+        snprintf(value, sizeof(value), "%ld", max_hz);
+        write_sysfs(GPU_DEVFREQ "/max_freq", value);
+    }
+    if (min_hz > 0)
+    {
+        snprintf(value, sizeof(value), "%ld", min_hz);
+        write_sysfs(GPU_DEVFREQ "/min_freq", value);
+    }
+}
+
+static long read_sysfs_long(const char *path)
+{
+    long value = 0;
+    FILE *fp = fopen(path, "r");
+    if (fp)
+    {
+        if (fscanf(fp, "%ld", &value) != 1)
+            value = 0;
+        fclose(fp);
+    }
+    return value;
+}
+
+void profile_apply(const Profile *profile)
+{
+    set_cpu_governor(profile->cpu_governor);
+    set_gpu_governor(profile->gpu_governor);
+    set_cpu_freq_range(profile->cpu_min_freq, profile->cpu_max_freq);
+    set_gpu_freq_range(profile->gpu_min_freq, profile->gpu_max_freq);
+
+    if (profile->cpu_min_freq || profile->cpu_max_freq)
+        printf("CPU clocks: %ld-%ld kHz\n", profile->cpu_min_freq, profile->cpu_max_freq);
+    if (profile->gpu_min_freq || profile->gpu_max_freq)
+        printf("GPU clocks: %ld-%ld Hz\n", profile->gpu_min_freq, profile->gpu_max_freq);
+}
+
+// Runs in the forked child right before exec, everything here is inherited
+void profile_apply_child(const Profile *profile)
+{
+    if (profile->cpu_affinity)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < NUM_CPUS; cpu++)
+        {
+            if (profile->cpu_affinity & (1 << cpu))
+                CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+            fprintf(stderr, "Could not set CPU affinity: %s\n", strerror(errno));
+    }
+
+    if (profile->nice && setpriority(PRIO_PROCESS, 0, profile->nice) != 0)
+        fprintf(stderr, "Could not set nice level: %s\n", strerror(errno));
+
+    if (profile->sched_policy != SCHED_OTHER)
+    {
+        struct sched_param param = {.sched_priority = profile->sched_priority};
+        if (param.sched_priority <= 0)
+            param.sched_priority = 1;
+        if (sched_setscheduler(0, profile->sched_policy, &param) != 0)
+            fprintf(stderr, "Could not set scheduler policy: %s\n", strerror(errno));
+    }
+}
+
+// Keeps the emulator's main thread alone on isolate_cpu and all of its other
+// threads off it. Threads spawned after the last call inherit the main
+// thread's mask, so the caller repeats this while the game is starting up.
+// A thread the emulator pinned to one other core itself (yabasanshiro's
+// --thread-cpus) is left where it is.
+void profile_pin_threads(const Profile *profile, pid_t pid)
+{
+    if (profile->isolate_cpu < 0 || profile->isolate_cpu >= NUM_CPUS)
+        return;
+
+    int others = profile->cpu_affinity ? profile->cpu_affinity : (1 << NUM_CPUS) - 1;
+    others &= ~(1 << profile->isolate_cpu);
+    if (!others)
+        return;
+
+    char task_dir[64];
+    snprintf(task_dir, sizeof(task_dir), "/proc/%d/task", (int)pid);
+    DIR *dir = opendir(task_dir);
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        pid_t tid = (pid_t)atoi(entry->d_name);
+        cpu_set_t set;
+        if (tid != pid && sched_getaffinity(tid, sizeof(set), &set) == 0 && CPU_COUNT(&set) == 1 &&
+            !CPU_ISSET(profile->isolate_cpu, &set))
+            continue;
+
+        CPU_ZERO(&set);
+        if (tid == pid)
+        {
+            CPU_SET(profile->isolate_cpu, &set);
+        }
+        else
+        {
+            for (int cpu = 0; cpu < NUM_CPUS; cpu++)
+            {
+                if (others & (1 << cpu))
+                    CPU_SET(cpu, &set);
+            }
+        }
+        sched_setaffinity(tid, sizeof(set), &set);
+    }
+    closedir(dir);
+}
+
+// Back to idle: powersave governors and the full OPP range
+void profile_reset(void)
+{
+    set_cpu_governor("powersave");
+    set_gpu_governor("powersave");
+
+    long cpu_min = read_sysfs_long("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_min_freq");
+    long cpu_max = read_sysfs_long("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq");
+    if (cpu_min > 0 && cpu_max > 0)
+    {
+        char value[32];
+        snprintf(value, sizeof(value), "%ld", cpu_min);
+        set_cpufreq_attr("scaling_min_freq", value);
+        snprintf(value, sizeof(value), "%ld", cpu_max);
+        set_cpufreq_attr("scaling_max_freq", value);
+    }
+
+    // 0 drops any devfreq min/max constraint
+    write_sysfs(GPU_DEVFREQ "/min_freq", "0");
+    write_sysfs(GPU_DEVFREQ "/max_freq", "0");
+}
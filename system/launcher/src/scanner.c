@@ -0,0 +1,246 @@
+#define _DEFAULT_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+
+// One worker per partition so both SD cards are read in parallel.
+// Workers publish per-directory results, the render loop merges them.
+#define SCAN_BASES 2
+
+typedef struct
+{
+    Catalog catalog;
+    bool    ready;
+    bool    merged;
+} ScanPart;
+
+static const char *base_dirs[SCAN_BASES] = {"/mnt/games", "/mnt/games2"};
+
+static System *scan_systems = NULL;
+static int scan_count = 0;
+static ScanPart parts[MAX_SYSTEMS][SCAN_BASES];
+static pthread_mutex_t scan_lock = PTHREAD_MUTEX_INITIALIZER;
+static int workers_running = 0;
+static bool results_pending = false;
+static int scan_event_fd = -1; // Wakes the render loop when results land
+
+static bool has_extension(const char *filename, const char **extensions)
+{
+    if (!filename || !extensions)
+        return false;
+
+    const char *dot = strrchr(filename, '.');
+    if (!dot)
+        return false;
+
+    for (int i = 0; extensions[i]; i++)
+    {
+        if (strcasecmp(dot, extensions[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void scan_dir(const System *system, const char *rom_dir, Catalog *cat)
+{
+    struct stat st;
+    if (stat(rom_dir, &st) != 0 || !S_ISDIR(st.st_mode))
+        return;
+
+    // Unchanged directories come straight from the on-disk index
+    if (game_cache_load(rom_dir, &st, system->extensions, cat) >= 0)
+        return;
+
+    DIR *dir = opendir(rom_dir);
+    if (!dir)
+        return;
+
+    int dir_index = catalog_intern_dir(cat, rom_dir);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        // Only skip directories, regular files may be DT_UNKNOWN
+        if (entry->d_type == DT_DIR)
+            continue;
+
+        if (has_extension(entry->d_name, system->extensions))
+        {
+            char name[sizeof(entry->d_name)];
+
+            // Copy filename without extension as game name
+            snprintf(name, sizeof(name), "%s", entry->d_name);
+            char *dot = strrchr(name, '.');
+            if (dot)
+                *dot = '\0';
+
+            // Remove parenthesized, bracketed, and braced annotations (e.g. "(USA)", "[!]", "{v1.0}")
+            static const char open_brackets[]  = "([{";
+            static const char close_brackets[] = ")]}";
+            for (int b = 0; b < 3; b++) {
+                char *open = name;
+                while ((open = strchr(open, open_brackets[b])) != NULL) {
+                    char *close = strchr(open, close_brackets[b]);
+                    if (!close) break;
+                    memmove(open, close + 1, strlen(close + 1) + 1);
+                }
+            }
+            // Trim trailing whitespace left behind
+            char *end = name + strlen(name) - 1;
+            while (end > name && *end == ' ')
+                *end-- = '\0';
+
+            if (!catalog_add(cat, dir_index, name, entry->d_name))
+                break;
+        }
+    }
+    closedir(dir);
+
+    game_cache_store(rom_dir, &st, system->extensions, cat);
+}
+
+static void *scan_worker(void *arg)
+{
+    int base = (int)(intptr_t)arg;
+    uint64_t start = trace_now();
+
+    // Scanning the bare mount point would cache it as empty and nothing scans
+    // it again. rcS removes the file even when the mount fails, so this waits
+    // as long as a large card takes instead of giving up on it.
+    while (base == 1 && access(GAMES2_PENDING_PATH, F_OK) == 0)
+        usleep(20000);
+
+    for (int s = 0; s < scan_count; s++)
+    {
+        char rom_dir[32];
+        snprintf(rom_dir, sizeof(rom_dir), "%s/%s", base_dirs[base], scan_systems[s].short_name);
+
+        Catalog cat = {0};
+        scan_dir(&scan_systems[s], rom_dir, &cat);
+
+        pthread_mutex_lock(&scan_lock);
+        parts[s][base].catalog = cat;
+        parts[s][base].ready = true;
+        results_pending = true;
+        pthread_mutex_unlock(&scan_lock);
+
+        if (scan_event_fd >= 0)
+            eventfd_write(scan_event_fd, 1);
+    }
+
+    pthread_mutex_lock(&scan_lock);
+    bool last = --workers_running == 0;
+    pthread_mutex_unlock(&scan_lock);
+    trace_span("scan_games", start);
+
+    // Last one out writes the index, off the render thread
+    if (last)
+        game_cache_close();
+    return NULL;
+}
+
+bool scanner_start(System *systems, int count)
+{
+    scan_systems = systems;
+    scan_count = count;
+    memset(parts, 0, sizeof(parts));
+    for (int s = 0; s < scan_count; s++)
+        catalog_free(&systems[s].catalog);
+
+    game_cache_open();
+
+    if (scan_event_fd < 0)
+        scan_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    workers_running = SCAN_BASES;
+    for (int b = 0; b < SCAN_BASES; b++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, scan_worker, (void *)(intptr_t)b) != 0)
+        {
+            // Fall back to scanning this partition inline
+            fprintf(stderr, "Could not start scan thread: %s\n", strerror(errno));
+            scan_worker((void *)(intptr_t)b);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return true;
+}
+
+int scanner_fd(void)
+{
+    return scan_event_fd;
+}
+
+int scanner_poll(void)
+{
+    ScanPart *ready[MAX_SYSTEMS * SCAN_BASES];
+    int ready_count = 0;
+
+    if (scan_event_fd >= 0)
+    {
+        eventfd_t value;
+        eventfd_read(scan_event_fd, &value);
+    }
+
+    pthread_mutex_lock(&scan_lock);
+    if (results_pending)
+    {
+        for (int s = 0; s < scan_count; s++)
+        {
+            for (int b = 0; b < SCAN_BASES; b++)
+            {
+                if (parts[s][b].ready && !parts[s][b].merged)
+                {
+                    parts[s][b].merged = true;
+                    ready[ready_count++] = &parts[s][b];
+                }
+            }
+        }
+        results_pending = false;
+    }
+    pthread_mutex_unlock(&scan_lock);
+
+    // Published parts are immutable, merge them without holding the lock
+    int changed = 0;
+    for (int i = 0; i < ready_count; i++)
+    {
+        int s = (ready[i] - &parts[0][0]) / SCAN_BASES;
+        if (!catalog_merge(&scan_systems[s].catalog, &ready[i]->catalog))
+            fprintf(stderr, "Out of memory merging %s games\n", scan_systems[s].name);
+
+        catalog_free(&ready[i]->catalog);
+        changed |= 1 << s;
+    }
+
+    for (int s = 0; s < scan_count; s++)
+    {
+        if (!(changed & (1 << s)))
+            continue;
+
+        System *system = &scan_systems[s];
+        // Sort games alphabetically by name
+        catalog_sort(&system->catalog);
+
+        if (scanner_system_done(s))
+            printf("Found %d games for %s\n", system->catalog.count, system->name);
+    }
+
+    return changed;
+}
+
+bool scanner_system_done(int system_index)
+{
+    for (int b = 0; b < SCAN_BASES; b++)
+    {
+        if (!parts[system_index][b].merged)
+            return false;
+    }
+    return true;
+}
@@ -9,6 +9,77 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <time.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// Menu
+#define MAX_SYSTEMS 6
+#define CATALOG_MAX_DIRS 4
+
+#define CATALOG_MAX_JUMPS 32
+
+// Offsets into the owning catalog's string arena
+typedef struct
+{
+    uint32_t name;
+    uint32_t file;
+    uint32_t dir;
+    uint32_t key; // Lowercased name, sorts and searches with plain strcmp
+} Game;
+
+typedef struct
+{
+    char    *arena;
+    uint32_t arena_size;
+    uint32_t arena_cap;
+    Game    *games;
+    int      count;
+    int      cap;
+    uint32_t dirs[CATALOG_MAX_DIRS]; // Interned ROM directory prefixes
+    int      dir_count;
+    int      jumps[CATALOG_MAX_JUMPS]; // First index of each initial letter, set by catalog_sort
+    int      jump_count;
+} Catalog;
+
+// How a system's emulator is started, from /etc/mimiki/systems.ini. The
+// strings are read once, argv, envp and the prefetch list point into them.
+#define LAUNCH_MAX_ARGS     16
+#define LAUNCH_MAX_ENV      8
+#define LAUNCH_MAX_PREFETCH 8
+#define LAUNCH_MAX_EXTS     8
+
+typedef struct
+{
+    char short_name[16];
+    char name[32];
+    char binary[PATH_MAX];
+    char args[512];            // Tokenized in place, %rom marks the game path
+    char extensions[128];
+    char profile[32];          // profiles.ini section, the short name by default
+    char post_exit[256];       // Run with /bin/sh -c once the emulator is gone
+    char bench_args[512];      // Headless run for --bench, %rom and %frames are replaced
+    char env[LAUNCH_MAX_ENV][128];
+    int  env_count;
+    char prefetch_paths[LAUNCH_MAX_PREFETCH][PATH_MAX];
+    int  prefetch_count;
+
+    const char  *argv[LAUNCH_MAX_ARGS + 1];
+    int          argc;
+    int          rom_arg;      // Index of %rom in argv, -1 appends the path
+    const char **envp;         // The launcher's environment with env applied
+    const char  *prefetch[LAUNCH_MAX_PREFETCH + 2]; // Binary first
+    const char  *exts[LAUNCH_MAX_EXTS + 1];
+} Launch;
+
+typedef struct
+{
+    const char *name;
+    const char *short_name;
+    const char **extensions;
+    const Launch *launch;
+    Catalog catalog;
+} System;
 
 extern bool backlight_on;
 
@@ -18,6 +89,119 @@ extern bool backlight_on;
 
 bool input_monitor_init(void);
 int  input_monitor_check_hotkeys(void);
+int  input_monitor_wait(int timeout_ms, const int *wake_fds, int wake_count);
+bool input_monitor_watch_start(pid_t pid);
+int  input_monitor_watch_wait(int timeout_ms, bool *exited);
+void input_monitor_watch_stop(void);
 void input_monitor_cleanup(void);
 
+void        catalog_free(Catalog *cat);
+int         catalog_intern_dir(Catalog *cat, const char *dir);
+bool        catalog_add(Catalog *cat, int dir, const char *name, const char *file);
+bool        catalog_merge(Catalog *dst, const Catalog *src);
+void        catalog_sort(Catalog *cat);
+const char *catalog_name(const Catalog *cat, int index);
+const char *catalog_file(const Catalog *cat, int index);
+int         catalog_path(const Catalog *cat, int index, char *buf, size_t size);
+int         catalog_art_path(const Catalog *cat, int index, char *buf, size_t size);
+const char *catalog_key(const Catalog *cat, int index);
+void        catalog_prefix_range(const Catalog *cat, const char *prefix, int *lo, int *hi);
+int         catalog_next_letter(const Catalog *cat, int index);
+int         catalog_prev_letter(const Catalog *cat, int index);
+
+bool game_cache_open(void);
+int  game_cache_load(const char *dir, const struct stat *st, const char **extensions, Catalog *cat);
+void game_cache_store(const char *dir, const struct stat *st, const char **extensions, const Catalog *cat);
+void game_cache_close(void);
+
+// rcS mounts the second card in the background and removes this once done
+#define GAMES2_PENDING_PATH "/dev/shm/mimiki-games2.pending"
+
+bool scanner_start(System *systems, int count);
+int  scanner_fd(void);
+int  scanner_poll(void);
+bool scanner_system_done(int system_index);
+
+// Game list artwork, THUMB_MAX_REQUEST covers the visible page and the next
+#define THUMB_WIDTH       80
+#define THUMB_HEIGHT      60
+#define THUMB_MAX_REQUEST 20
+
+struct SDL_Renderer;
+void thumbs_attach(struct SDL_Renderer *renderer);
+void thumbs_request(const char *system, const char *const *paths, int count);
+void thumbs_cancel(void);
+int  thumbs_fd(void);
+bool thumbs_poll(void);
+bool thumbs_draw(const char *path, int x, int y);
+
+void prefetch_system(const char *const *paths);
+void prefetch_game(const char *path);
+
+void display_attach(int drm_fd);
+bool display_release(void);
+bool display_reclaim(int timeout_ms);
+
+bool control_init(void);
+bool control_set_backlight(int level);
+bool control_suspend(void);
+bool control_adjust_volume(int percent);
+bool control_set_headphones(bool headphones);
+bool control_find_battery(char *dir, size_t size);
+void control_cleanup(void);
+
+uint64_t trace_now(void);
+void trace_span(const char *name, uint64_t start);
+void trace_mark(const char *name);
+void trace_dump(void);
+
+void bench_init(void);
+bool bench_enabled(void);
+void bench_mark(const char *stage);
+void bench_flush(void);
+const char *bench_build_tag(void);
+const char *bench_boot_id(void);
+
+// Performance profile applied around an emulator launch
+typedef struct
+{
+    char cpu_governor[32];
+    char gpu_governor[32];
+    long cpu_min_freq; // kHz, 0 leaves the policy alone
+    long cpu_max_freq;
+    long gpu_min_freq; // Hz
+    long gpu_max_freq;
+    int  cpu_affinity; // Bit mask, 0 = all cores
+    int  nice;
+    int  sched_policy;
+    int  sched_priority;
+    int  isolate_cpu;  // Core reserved for the emulator's main thread, -1 = off
+    char args[256];    // Extra emulator arguments, space separated
+} Profile;
+
+typedef void (*IniHandler)(void *ctx, const char *section, const char *key, const char *value);
+char *ini_trim(char *str);
+bool ini_parse(const char *path, IniHandler handler, void *ctx);
+
+void set_cpu_governor(const char *cpu_gov);
+void set_gpu_governor(const char *gpu_gov);
+void profile_load(Profile *profile, const char *system, const char *game_name, const char *game_file);
+void profile_apply(const Profile *profile);
+void profile_apply_child(const Profile *profile);
+void profile_pin_threads(const Profile *profile, pid_t pid);
+void profile_reset(void);
+
+void governor_start(const Profile *profile);
+void governor_stop(void);
+int  governor_timeout(void);
+void governor_poll(void);
+
+int  launch_load_systems(System *systems, int max);
+void launch_exec(const Launch *launch, const char *rom, const Profile *profile);
+void launch_post_exit(const Launch *launch);
+void launch_exec_bench(const Launch *launch, const char *rom, const char *frames, const Profile *profile);
+
+bool benchmark_due(void);
+int  benchmark_run(const char *list_path, const System *systems, int count);
+
 #endif // INPUT_MONITOR_H
@@ -0,0 +1,549 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <pthread.h>
+#include <png.h>
+#include <sys/eventfd.h>
+#include <SDL2/SDL.h>
+
+// Game list artwork. Art lives next to the ROMs as media/<rom>.png, a worker
+// thread scales it down once and keeps the result in a per-system atlas
+// file of fixed-size RGB565 slots, so browsing an unchanged library never
+// decodes a PNG. Thumbnails for the visible page and the next one are
+// handed to the main thread, which copies them into a single GPU atlas
+// texture with a fixed number of LRU-managed slots.
+#define THUMB_DIR         "/mnt/games/data/.cache"
+#define THUMB_MAGIC       0x424D4854u // "THMB"
+#define THUMB_VERSION     1
+#define THUMB_MAX_SOURCE  4096        // Larger art is skipped rather than decoded
+#define THUMB_PIXELS      (THUMB_WIDTH * THUMB_HEIGHT)
+#define THUMB_GPU_COLS    8
+#define THUMB_GPU_ROWS    4
+#define THUMB_GPU_SLOTS   (THUMB_GPU_COLS * THUMB_GPU_ROWS)
+#define THUMB_ENTRIES     (THUMB_GPU_SLOTS * 2) // Resident plus known-missing art
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+} ThumbFileHeader;
+
+// Followed by THUMB_PIXELS RGB565 pixels, records are rewritten in place
+// when their source image changes
+typedef struct
+{
+    uint64_t key;
+    int64_t  mtime_sec;
+    int64_t  size;
+    uint64_t reserved;
+} ThumbRecord;
+
+#define THUMB_RECORD_SIZE (sizeof(ThumbRecord) + THUMB_PIXELS * sizeof(uint16_t))
+
+typedef struct
+{
+    uint64_t key;
+    int64_t  mtime_sec;
+    int64_t  size;
+    uint32_t index;
+} ThumbIndex;
+
+typedef struct
+{
+    uint64_t key;
+    bool     found;
+    uint32_t pixels[THUMB_PIXELS]; // XRGB8888, ready for SDL_UpdateTexture
+} ThumbResult;
+
+typedef struct
+{
+    uint64_t key;
+    int      slot;      // -1 when the game has no art
+    uint32_t last_used;
+} ThumbEntry;
+
+// Worker state, guarded by thumb_lock
+static pthread_t thumb_thread;
+static bool thumb_started = false;
+static pthread_mutex_t thumb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thumb_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t request_gen = 0;
+static char request_system[16] = "";
+static char request_paths[THUMB_MAX_REQUEST][PATH_MAX];
+static int request_count = 0;
+static ThumbResult *ready[THUMB_MAX_REQUEST];
+static int ready_count = 0;
+static int ready_fd = -1;
+
+// Worker only: the open atlas file and its index
+static int atlas_fd = -1;
+static char atlas_system[16] = "";
+static ThumbIndex *atlas_index = NULL;
+static uint32_t atlas_count = 0;
+static uint32_t atlas_cap = 0;
+
+// Main thread only
+static SDL_Renderer *thumb_renderer = NULL;
+static SDL_Texture *thumb_texture = NULL;
+static ThumbEntry entries[THUMB_ENTRIES];
+static int entry_count = 0;
+static bool slot_used[THUMB_GPU_SLOTS];
+static uint32_t use_tick = 0;
+
+static uint64_t thumb_key(const char *path)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static void close_atlas(void)
+{
+    if (atlas_fd >= 0)
+        close(atlas_fd);
+    atlas_fd = -1;
+    atlas_system[0] = '\0';
+    free(atlas_index);
+    atlas_index = NULL;
+    atlas_count = atlas_cap = 0;
+}
+
+static bool index_add(const ThumbRecord *rec, uint32_t index)
+{
+    if (atlas_count == atlas_cap)
+    {
+        uint32_t cap = atlas_cap ? atlas_cap * 2 : 64;
+        ThumbIndex *grown = realloc(atlas_index, cap * sizeof(ThumbIndex));
+        if (!grown)
+            return false;
+        atlas_index = grown;
+        atlas_cap = cap;
+    }
+    atlas_index[atlas_count++] = (ThumbIndex){rec->key, rec->mtime_sec, rec->size, index};
+    return true;
+}
+
+static bool open_atlas(const char *system)
+{
+    if (atlas_fd >= 0 && strcmp(atlas_system, system) == 0)
+        return true;
+    close_atlas();
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), THUMB_DIR "/thumbs-%s.atlas", system);
+    mkdir(THUMB_DIR, 0755);
+    atlas_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (atlas_fd < 0)
+    {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    snprintf(atlas_system, sizeof(atlas_system), "%s", system);
+
+    ThumbFileHeader hdr;
+    struct stat st;
+    bool valid = fstat(atlas_fd, &st) == 0 &&
+                 pread(atlas_fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+                 hdr.magic == THUMB_MAGIC && hdr.version == THUMB_VERSION &&
+                 hdr.width == THUMB_WIDTH && hdr.height == THUMB_HEIGHT;
+    if (!valid)
+    {
+        hdr = (ThumbFileHeader){THUMB_MAGIC, THUMB_VERSION, THUMB_WIDTH, THUMB_HEIGHT};
+        if (ftruncate(atlas_fd, 0) != 0 || pwrite(atlas_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        {
+            close_atlas();
+            return false;
+        }
+        return true;
+    }
+
+    // A torn last record from a power cut is dropped
+    uint32_t records = (st.st_size - sizeof(hdr)) / THUMB_RECORD_SIZE;
+    for (uint32_t i = 0; i < records; i++)
+    {
+        ThumbRecord rec;
+        off_t offset = sizeof(hdr) + (off_t)i * THUMB_RECORD_SIZE;
+        if (pread(atlas_fd, &rec, sizeof(rec), offset) != sizeof(rec) || !index_add(&rec, i))
+            break;
+    }
+    return true;
+}
+
+static ThumbIndex *index_find(uint64_t key)
+{
+    for (uint32_t i = 0; i < atlas_count; i++)
+    {
+        if (atlas_index[i].key == key)
+            return &atlas_index[i];
+    }
+    return NULL;
+}
+
+// Box-filters the decoded art into the thumbnail, letterboxed on black
+static void scale_rgb565(const uint8_t *src, int src_w, int src_h, uint16_t *dst)
+{
+    int w = THUMB_WIDTH, h = src_h * THUMB_WIDTH / src_w;
+    if (h > THUMB_HEIGHT)
+    {
+        h = THUMB_HEIGHT;
+        w = src_w * THUMB_HEIGHT / src_h;
+    }
+    if (w < 1)
+        w = 1;
+    if (h < 1)
+        h = 1;
+    int off_x = (THUMB_WIDTH - w) / 2, off_y = (THUMB_HEIGHT - h) / 2;
+
+    memset(dst, 0, THUMB_PIXELS * sizeof(uint16_t));
+    for (int y = 0; y < h; y++)
+    {
+        int y0 = y * src_h / h, y1 = (y + 1) * src_h / h;
+        if (y1 <= y0)
+            y1 = y0 + 1;
+        for (int x = 0; x < w; x++)
+        {
+            int x0 = x * src_w / w, x1 = (x + 1) * src_w / w;
+            if (x1 <= x0)
+                x1 = x0 + 1;
+
+            uint32_t r = 0, g = 0, b = 0, n = 0;
+            for (int sy = y0; sy < y1; sy++)
+            {
+                const uint8_t *p = src + ((size_t)sy * src_w + x0) * 3;
+                for (int sx = x0; sx < x1; sx++, p += 3, n++)
+                {
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                }
+            }
+            r /= n;
+            g /= n;
+            b /= n;
+            dst[(off_y + y) * THUMB_WIDTH + off_x + x] =
+                (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        }
+    }
+}
+
+static bool decode_art(const char *path, uint16_t *dst)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&image, path))
+        return false;
+
+    if (image.width == 0 || image.height == 0 ||
+        image.width > THUMB_MAX_SOURCE || image.height > THUMB_MAX_SOURCE)
+    {
+        png_image_free(&image);
+        return false;
+    }
+
+    image.format = PNG_FORMAT_RGB;
+    uint8_t *pixels = malloc(PNG_IMAGE_SIZE(image));
+    png_color background = {0, 0, 0};
+    if (!pixels || !png_image_finish_read(&image, &background, pixels, 0, NULL))
+    {
+        fprintf(stderr, "Could not decode %s: %s\n", path, image.message);
+        png_image_free(&image);
+        free(pixels);
+        return false;
+    }
+
+    scale_rgb565(pixels, (int)image.width, (int)image.height, dst);
+    free(pixels);
+    return true;
+}
+
+// Fills result from the atlas, decoding and storing the art when the cached
+// copy is missing or older than the source
+static void load_thumb(const char *path, ThumbResult *result)
+{
+    static uint16_t packed[THUMB_PIXELS];
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return;
+
+    ThumbIndex *entry = index_find(result->key);
+    bool cached = entry && entry->mtime_sec == (int64_t)st.st_mtime && entry->size == (int64_t)st.st_size;
+    off_t offset = 0;
+    if (entry)
+        offset = sizeof(ThumbFileHeader) + (off_t)entry->index * THUMB_RECORD_SIZE;
+
+    if (cached)
+    {
+        cached = pread(atlas_fd, packed, sizeof(packed), offset + sizeof(ThumbRecord)) ==
+                 (ssize_t)sizeof(packed);
+    }
+
+    if (!cached)
+    {
+        if (!decode_art(path, packed))
+            return;
+
+        ThumbRecord rec = {result->key, (int64_t)st.st_mtime, (int64_t)st.st_size, 0};
+        if (!entry)
+        {
+            offset = sizeof(ThumbFileHeader) + (off_t)atlas_count * THUMB_RECORD_SIZE;
+            if (index_add(&rec, atlas_count))
+                entry = &atlas_index[atlas_count - 1];
+        }
+        // Pixels first, so a torn write never leaves a record that looks valid
+        if (entry && pwrite(atlas_fd, packed, sizeof(packed), offset + sizeof(rec)) == (ssize_t)sizeof(packed) &&
+            pwrite(atlas_fd, &rec, sizeof(rec), offset) == (ssize_t)sizeof(rec))
+        {
+            entry->mtime_sec = rec.mtime_sec;
+            entry->size = rec.size;
+        }
+    }
+
+    for (int i = 0; i < THUMB_PIXELS; i++)
+    {
+        uint16_t p = packed[i];
+        uint32_t r = (p >> 11) & 0x1F, g = (p >> 5) & 0x3F, b = p & 0x1F;
+        result->pixels[i] = ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+    }
+    result->found = true;
+}
+
+static void *thumb_worker(void *arg)
+{
+    (void)arg;
+    uint32_t done_gen = 0;
+    char system[16];
+    char path[PATH_MAX];
+
+    pthread_mutex_lock(&thumb_lock);
+    while (true)
+    {
+        while (done_gen == request_gen)
+            pthread_cond_wait(&thumb_cond, &thumb_lock);
+
+        uint32_t gen = request_gen;
+        snprintf(system, sizeof(system), "%s", request_system);
+        for (int i = 0; i < request_count && gen == request_gen; i++)
+        {
+            snprintf(path, sizeof(path), "%s", request_paths[i]);
+            pthread_mutex_unlock(&thumb_lock);
+
+            ThumbResult *result = malloc(sizeof(ThumbResult));
+            if (result)
+            {
+                result->key = thumb_key(path);
+                result->found = false;
+                if (open_atlas(system))
+                    load_thumb(path, result);
+            }
+
+            pthread_mutex_lock(&thumb_lock);
+            // Results of a superseded request are still valid thumbnails
+            if (result && ready_count < THUMB_MAX_REQUEST)
+                ready[ready_count++] = result;
+            else
+                free(result);
+            if (ready_fd >= 0)
+                eventfd_write(ready_fd, 1);
+        }
+        done_gen = gen;
+    }
+    return NULL;
+}
+
+int thumbs_fd(void)
+{
+    return ready_fd;
+}
+
+static ThumbEntry *entry_find(uint64_t key)
+{
+    for (int i = 0; i < entry_count; i++)
+    {
+        if (entries[i].key == key)
+            return &entries[i];
+    }
+    return NULL;
+}
+
+// Asks for the art of the given games, the first page's worth most urgently.
+// Anything already resident is skipped, an empty list cancels.
+void thumbs_request(const char *system, const char *const *paths, int count)
+{
+    if (!thumb_started)
+    {
+        ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (pthread_create(&thumb_thread, NULL, thumb_worker, NULL) != 0)
+        {
+            fprintf(stderr, "Could not start thumbnail thread\n");
+            return;
+        }
+        thumb_started = true;
+    }
+
+    use_tick++;
+    pthread_mutex_lock(&thumb_lock);
+    snprintf(request_system, sizeof(request_system), "%s", system);
+    request_count = 0;
+    for (int i = 0; i < count && i < THUMB_MAX_REQUEST; i++)
+    {
+        ThumbEntry *entry = entry_find(thumb_key(paths[i]));
+        if (entry)
+        {
+            entry->last_used = use_tick;
+            continue;
+        }
+        snprintf(request_paths[request_count++], PATH_MAX, "%s", paths[i]);
+    }
+    request_gen++;
+    pthread_cond_signal(&thumb_cond);
+    pthread_mutex_unlock(&thumb_lock);
+}
+
+void thumbs_cancel(void)
+{
+    if (!thumb_started)
+        return;
+
+    pthread_mutex_lock(&thumb_lock);
+    request_count = 0;
+    request_gen++;
+    pthread_cond_signal(&thumb_cond);
+    pthread_mutex_unlock(&thumb_lock);
+}
+
+// Oldest entry, optionally only among those holding a GPU slot
+static ThumbEntry *entry_evict(bool need_slot)
+{
+    ThumbEntry *oldest = NULL;
+    for (int i = 0; i < entry_count; i++)
+    {
+        if (need_slot && entries[i].slot < 0)
+            continue;
+        if (!oldest || entries[i].last_used < oldest->last_used)
+            oldest = &entries[i];
+    }
+    return oldest;
+}
+
+static int slot_acquire(void)
+{
+    for (int i = 0; i < THUMB_GPU_SLOTS; i++)
+    {
+        if (!slot_used[i])
+        {
+            slot_used[i] = true;
+            return i;
+        }
+    }
+
+    ThumbEntry *victim = entry_evict(true);
+    int slot = victim->slot;
+    victim->slot = -1;
+    victim->key = 0; // Make it the first candidate for reuse
+    victim->last_used = 0;
+    return slot;
+}
+
+static void store_result(const ThumbResult *result)
+{
+    ThumbEntry *entry = entry_find(result->key);
+    if (!entry)
+    {
+        if (entry_count < THUMB_ENTRIES)
+        {
+            entry = &entries[entry_count++];
+        }
+        else
+        {
+            entry = entry_evict(false);
+            if (entry->slot >= 0)
+                slot_used[entry->slot] = false;
+        }
+        entry->key = result->key;
+        entry->slot = -1;
+    }
+    entry->last_used = use_tick;
+
+    if (!result->found || entry->slot >= 0)
+        return;
+
+    if (!thumb_texture)
+    {
+        thumb_texture = SDL_CreateTexture(thumb_renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STATIC,
+                                          THUMB_GPU_COLS * THUMB_WIDTH, THUMB_GPU_ROWS * THUMB_HEIGHT);
+        if (!thumb_texture)
+        {
+            fprintf(stderr, "Could not create thumbnail texture: %s\n", SDL_GetError());
+            return;
+        }
+    }
+
+    entry->slot = slot_acquire();
+    SDL_Rect rect = {(entry->slot % THUMB_GPU_COLS) * THUMB_WIDTH, (entry->slot / THUMB_GPU_COLS) * THUMB_HEIGHT,
+                     THUMB_WIDTH, THUMB_HEIGHT};
+    if (SDL_UpdateTexture(thumb_texture, &rect, result->pixels, THUMB_WIDTH * sizeof(uint32_t)) != 0)
+    {
+        slot_used[entry->slot] = false;
+        entry->slot = -1;
+    }
+}
+
+// Uploads finished thumbnails, returns true when any arrived
+bool thumbs_poll(void)
+{
+    if (!thumb_started)
+        return false;
+
+    eventfd_t value;
+    eventfd_read(ready_fd, &value);
+
+    ThumbResult *results[THUMB_MAX_REQUEST];
+    pthread_mutex_lock(&thumb_lock);
+    int count = ready_count;
+    memcpy(results, ready, count * sizeof(ThumbResult *));
+    ready_count = 0;
+    pthread_mutex_unlock(&thumb_lock);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (thumb_renderer)
+            store_result(results[i]);
+        free(results[i]);
+    }
+    return count > 0;
+}
+
+// False when the art isn't resident (yet), nothing is drawn then
+bool thumbs_draw(const char *path, int x, int y)
+{
+    ThumbEntry *entry = entry_find(thumb_key(path));
+    if (!entry || entry->slot < 0 || !thumb_texture)
+        return false;
+
+    entry->last_used = use_tick;
+    SDL_Rect src = {(entry->slot % THUMB_GPU_COLS) * THUMB_WIDTH, (entry->slot / THUMB_GPU_COLS) * THUMB_HEIGHT,
+                    THUMB_WIDTH, THUMB_HEIGHT};
+    SDL_Rect dst = {x, y, THUMB_WIDTH, THUMB_HEIGHT};
+    SDL_RenderCopy(thumb_renderer, thumb_texture, &src, &dst);
+    return true;
+}
+
+// The GPU atlas belongs to one renderer, NULL drops it with everything resident
+void thumbs_attach(SDL_Renderer *renderer)
+{
+    if (thumb_texture)
+        SDL_DestroyTexture(thumb_texture);
+    thumb_texture = NULL;
+    thumb_renderer = renderer;
+    entry_count = 0;
+    memset(slot_used, 0, sizeof(slot_used));
+}
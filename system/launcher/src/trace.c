@@ -0,0 +1,97 @@
+#define _GNU_SOURCE
+
+#include "shared.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+// Startup, frame and launch timings kept in a fixed ring and written out as
+// a Chrome trace (chrome://tracing, ui.perfetto.dev). Timestamps are
+// CLOCK_BOOTTIME, so an event's ts is also its time since kernel start.
+#define TRACE_PATH       "/dev/shm/mimiki-trace.json"
+#define TRACE_TMP_PATH   "/dev/shm/mimiki-trace.json.tmp"
+#define TRACE_MAX_EVENTS 4096
+
+typedef struct
+{
+    const char *name; // Must be a string literal
+    uint64_t    ts;   // us
+    uint64_t    dur;  // us, 0 for instant events
+    int         tid;
+    bool        instant;
+} TraceEvent;
+
+static TraceEvent events[TRACE_MAX_EVENTS];
+static uint32_t event_count = 0; // Total recorded, the ring keeps the last TRACE_MAX_EVENTS
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local int trace_tid = 0;
+
+uint64_t trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void trace_record(const char *name, uint64_t ts, uint64_t dur, bool instant)
+{
+    if (!trace_tid)
+        trace_tid = (int)syscall(SYS_gettid);
+
+    pthread_mutex_lock(&trace_lock);
+    TraceEvent *ev = &events[event_count % TRACE_MAX_EVENTS];
+    ev->name = name;
+    ev->ts = ts;
+    ev->dur = dur;
+    ev->tid = trace_tid;
+    ev->instant = instant;
+    event_count++;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+// Records a span from start (a trace_now() value) until now
+void trace_span(const char *name, uint64_t start)
+{
+    uint64_t now = trace_now();
+    trace_record(name, start, now - start, false);
+}
+
+void trace_mark(const char *name)
+{
+    trace_record(name, trace_now(), 0, true);
+}
+
+void trace_dump(void)
+{
+    FILE *fp = fopen(TRACE_TMP_PATH, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "Could not write trace: %s\n", strerror(errno));
+        return;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    uint32_t first = event_count > TRACE_MAX_EVENTS ? event_count - TRACE_MAX_EVENTS : 0;
+    int pid = (int)getpid();
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (uint32_t i = first; i < event_count; i++)
+    {
+        const TraceEvent *ev = &events[i % TRACE_MAX_EVENTS];
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,", i == first ? "" : ",\n",
+                ev->name, ev->instant ? "i" : "X", (unsigned long long)ev->ts);
+        if (ev->instant)
+            fprintf(fp, "\"s\":\"g\",");
+        else
+            fprintf(fp, "\"dur\":%llu,", (unsigned long long)ev->dur);
+        fprintf(fp, "\"pid\":%d,\"tid\":%d}", pid, ev->tid);
+    }
+    fprintf(fp, "\n]}\n");
+    pthread_mutex_unlock(&trace_lock);
+
+    if (fclose(fp) != 0 || rename(TRACE_TMP_PATH, TRACE_PATH) != 0)
+    {
+        fprintf(stderr, "Could not write trace: %s\n", strerror(errno));
+        unlink(TRACE_TMP_PATH);
+    }
+}
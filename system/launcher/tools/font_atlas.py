@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+# MIMIKI - Converts the greyscale font atlas PNG into a C header so the
+# launcher needs no image decoder. Only the standard library is used, the
+# atlas is one coverage byte per pixel.
+
+import struct
+import sys
+import zlib
+
+
+def unfilter(raw, width, height):
+    pixels = bytearray()
+    prev = bytearray(width)
+    stride = width + 1
+    for y in range(height):
+        kind = raw[y * stride]
+        line = bytearray(raw[y * stride + 1:(y + 1) * stride])
+        for x in range(width):
+            a = line[x - 1] if x else 0
+            b = prev[x]
+            c = prev[x - 1] if x else 0
+            if kind == 1:
+                line[x] = (line[x] + a) & 0xFF
+            elif kind == 2:
+                line[x] = (line[x] + b) & 0xFF
+            elif kind == 3:
+                line[x] = (line[x] + (a + b) // 2) & 0xFF
+            elif kind == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                pred = a if pa <= pb and pa <= pc else (b if pb <= pc else c)
+                line[x] = (line[x] + pred) & 0xFF
+            elif kind != 0:
+                sys.exit(f"font_atlas: unknown PNG filter {kind}")
+        pixels += line
+        prev = line
+    return pixels
+
+
+def load_png(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        sys.exit(f"font_atlas: {path} is not a PNG")
+
+    pos = 8
+    header = None
+    idat = b""
+    while pos < len(data):
+        length, kind = struct.unpack(">I4s", data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        pos += length + 12
+        if kind == b"IHDR":
+            header = struct.unpack(">IIBBBBB", chunk)
+        elif kind == b"IDAT":
+            idat += chunk
+        elif kind == b"IEND":
+            break
+
+    width, height, depth, color, _, _, interlace = header
+    if depth != 8 or color != 0 or interlace != 0:
+        sys.exit(f"font_atlas: {path} must be 8-bit greyscale, non-interlaced")
+    return width, height, unfilter(zlib.decompress(idat), width, height)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: font_atlas.py font.png font_atlas.h")
+
+    width, height, pixels = load_png(sys.argv[1])
+    with open(sys.argv[2], "w") as out:
+        out.write("/* Generated from %s by tools/font_atlas.py, do not edit */\n"
+                  % sys.argv[1].rsplit("/", 1)[-1])
+        out.write("#ifndef FONT_ATLAS_H\n#define FONT_ATLAS_H\n\n")
+        out.write(f"#define FONT_ATLAS_DATA_WIDTH {width}\n")
+        out.write(f"#define FONT_ATLAS_DATA_HEIGHT {height}\n\n")
+        out.write("static const unsigned char font_atlas_data[%d] = {\n" % len(pixels))
+        for i in range(0, len(pixels), 16):
+            out.write("    " + ", ".join(str(p) for p in pixels[i:i + 16]) + ",\n")
+        out.write("};\n\n#endif /* FONT_ATLAS_H */\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,307 @@
+// Disc image caching for the kmsdrm port.
+//
+// The ISO core decompresses a CHD hunk on the emulation thread for every
+// sector it misses. chd_read/chd_close are wrapped at link time
+// (-Wl,--wrap) so decompressed hunks land in an LRU, and a worker decodes
+// the hunks following a sequential run before the core asks for them.
+// Separately, a single-file image can be copied to /dev/shm up front so no
+// read touches the SD card at all.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <libchdr/chd.h>
+
+// Set by main.cpp before the disc is opened, 0 disables the hunk cache
+size_t g_cd_cache_bytes = 16u << 20;
+
+#define READAHEAD_HUNKS   8
+#define PRELOAD_DIR       "/dev/shm/yabause"
+#define PRELOAD_SHM_SLACK (8ull << 20)   // Left free in /dev/shm
+#define PRELOAD_RAM_SLACK (192ull << 20) // Left available for the emulator
+
+struct Hunk {
+    uint32_t num;
+    std::vector<uint8_t> data;
+};
+
+static chd_file *s_chd = nullptr; // Disc the cache belongs to
+static uint32_t s_hunk_bytes = 0;
+static uint32_t s_total_hunks = 0;
+static std::list<Hunk> s_lru; // Most recently used first
+static std::unordered_map<uint32_t, std::list<Hunk>::iterator> s_index;
+static uint32_t s_last_hunk = UINT32_MAX;
+static uint32_t s_ahead_next = 0; // Next hunk the worker should decode
+static uint32_t s_ahead_end = 0;  // One past the last one it should decode
+
+static std::mutex s_lock;        // Everything above
+static std::mutex s_decode_lock; // chd_file isn't thread safe
+static std::condition_variable s_cv;
+static std::thread s_worker;
+static bool s_stop = false;
+
+static std::string s_preload_path;
+
+extern "C" chd_error __real_chd_read(chd_file *chd, UINT32 hunknum, void *buffer);
+extern "C" void __real_chd_close(chd_file *chd);
+
+// Called with s_lock held
+static void reset_cache(chd_file *chd) {
+    s_lru.clear();
+    s_index.clear();
+    s_chd = chd;
+    s_last_hunk = UINT32_MAX;
+    s_ahead_next = s_ahead_end = 0;
+
+    const chd_header *header = chd ? chd_get_header(chd) : nullptr;
+    s_hunk_bytes = header ? header->hunkbytes : 0;
+    s_total_hunks = header ? header->totalhunks : 0;
+}
+
+// Called with s_lock held
+static void insert_hunk(uint32_t num, std::vector<uint8_t> &&data) {
+    if (s_index.count(num))
+        return;
+
+    s_lru.push_front({num, std::move(data)});
+    s_index[num] = s_lru.begin();
+    while (!s_lru.empty() && s_lru.size() * (size_t)s_hunk_bytes > g_cd_cache_bytes) {
+        s_index.erase(s_lru.back().num);
+        s_lru.pop_back();
+    }
+}
+
+// Called with s_lock held, copies a cached hunk out and bumps it
+static bool lookup_hunk(uint32_t num, void *buffer) {
+    auto it = s_index.find(num);
+    if (it == s_index.end())
+        return false;
+
+    s_lru.splice(s_lru.begin(), s_lru, it->second);
+    memcpy(buffer, it->second->data.data(), s_hunk_bytes);
+    return true;
+}
+
+static void worker_main() {
+    std::unique_lock<std::mutex> lock(s_lock);
+    while (true) {
+        s_cv.wait(lock, [] { return s_stop || s_ahead_next < s_ahead_end; });
+        if (s_stop)
+            break;
+
+        chd_file *chd = s_chd;
+        uint32_t num = s_ahead_next++;
+        if (num >= s_total_hunks || s_index.count(num))
+            continue;
+
+        std::vector<uint8_t> data(s_hunk_bytes);
+        lock.unlock();
+
+        // The emulation thread waits at most for this one hunk to finish
+        chd_error err = CHDERR_INVALID_PARAMETER;
+        {
+            std::lock_guard<std::mutex> decode(s_decode_lock);
+            bool current;
+            {
+                // chd_close may have run since s_lock was dropped
+                std::lock_guard<std::mutex> relock(s_lock);
+                current = chd == s_chd;
+            }
+            if (current)
+                err = __real_chd_read(chd, num, data.data());
+        }
+
+        lock.lock();
+        if (err == CHDERR_NONE && chd == s_chd)
+            insert_hunk(num, std::move(data));
+    }
+}
+
+extern "C" chd_error __wrap_chd_read(chd_file *chd, UINT32 hunknum, void *buffer) {
+    if (g_cd_cache_bytes == 0) {
+        std::lock_guard<std::mutex> decode(s_decode_lock);
+        return __real_chd_read(chd, hunknum, buffer);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (chd != s_chd)
+            reset_cache(chd);
+        if (!s_worker.joinable()) {
+            s_stop = false;
+            s_worker = std::thread(worker_main);
+        }
+
+        // Only runs ahead of sequential access, so seeks don't thrash the LRU
+        bool sequential = s_last_hunk != UINT32_MAX && hunknum == s_last_hunk + 1;
+        s_last_hunk = hunknum;
+        if (sequential) {
+            if (s_ahead_next <= hunknum || s_ahead_next > hunknum + READAHEAD_HUNKS)
+                s_ahead_next = hunknum + 1;
+            s_ahead_end = hunknum + 1 + READAHEAD_HUNKS;
+            s_cv.notify_one();
+        }
+
+        if (lookup_hunk(hunknum, buffer))
+            return CHDERR_NONE;
+    }
+
+    std::lock_guard<std::mutex> decode(s_decode_lock);
+    {
+        // The worker may have decoded it while we waited
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (chd == s_chd && lookup_hunk(hunknum, buffer))
+            return CHDERR_NONE;
+    }
+
+    chd_error err = __real_chd_read(chd, hunknum, buffer);
+    if (err == CHDERR_NONE) {
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (chd == s_chd && s_hunk_bytes) {
+            const uint8_t *src = (const uint8_t *)buffer;
+            insert_hunk(hunknum, std::vector<uint8_t>(src, src + s_hunk_bytes));
+        }
+    }
+    return err;
+}
+
+extern "C" void __wrap_chd_close(chd_file *chd) {
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (chd == s_chd)
+            reset_cache(nullptr);
+    }
+
+    // Let an in-flight read-ahead of this disc finish first
+    std::lock_guard<std::mutex> decode(s_decode_lock);
+    __real_chd_close(chd);
+}
+
+void cd_cache_shutdown() {
+    if (s_worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(s_lock);
+            s_stop = true;
+        }
+        s_cv.notify_all();
+        s_worker.join();
+    }
+
+    std::lock_guard<std::mutex> lock(s_lock);
+    reset_cache(nullptr);
+}
+
+static unsigned long long mem_available() {
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp)
+        return 0;
+
+    char line[128];
+    unsigned long long kb = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1)
+            break;
+    }
+    fclose(fp);
+    return kb * 1024;
+}
+
+// A copy left by a run that crashed or was killed still holds tmpfs RAM and
+// would keep every later preload from fitting. Only one emulator runs at a
+// time, so anything in the directory is stale by now.
+static void clear_preload_dir() {
+    DIR *dir = opendir(PRELOAD_DIR);
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] != '.')
+            unlinkat(dirfd(dir), entry->d_name, 0);
+    }
+    closedir(dir);
+}
+
+// Copies a single-file image (CHD/ISO) to /dev/shm when both the tmpfs and
+// RAM have room for it, returns the path to use for the disc
+std::string cd_preload(const char *path) {
+    const char *ext = strrchr(path, '.');
+    if (!ext || (strcasecmp(ext, ".chd") != 0 && strcasecmp(ext, ".iso") != 0)) {
+        fprintf(stderr, "YabaSanshiro: preload only handles .chd and .iso images\n");
+        return path;
+    }
+
+    int in = open(path, O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        return path;
+
+    struct stat st;
+    struct statvfs vfs;
+    mkdir(PRELOAD_DIR, 0755);
+    clear_preload_dir();
+    if (fstat(in, &st) != 0 || statvfs(PRELOAD_DIR, &vfs) != 0) {
+        close(in);
+        return path;
+    }
+
+    unsigned long long size = (unsigned long long)st.st_size;
+    unsigned long long shm_free = (unsigned long long)vfs.f_bavail * vfs.f_frsize;
+    if (size + PRELOAD_SHM_SLACK > shm_free || size + PRELOAD_RAM_SLACK > mem_available()) {
+        fprintf(stderr, "YabaSanshiro: %llu MB image doesn't fit in RAM, not preloading\n",
+                size >> 20);
+        close(in);
+        return path;
+    }
+
+    const char *name = strrchr(path, '/');
+    std::string dest = std::string(PRELOAD_DIR "/") + (name ? name + 1 : path);
+    int out = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        close(in);
+        return path;
+    }
+
+    off_t offset = 0;
+    while (offset < st.st_size) {
+        ssize_t n = sendfile(out, in, &offset, st.st_size - offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+    }
+    close(in);
+    close(out);
+
+    if (offset != st.st_size) {
+        fprintf(stderr, "YabaSanshiro: preload failed: %s\n", strerror(errno));
+        unlink(dest.c_str());
+        return path;
+    }
+
+    fprintf(stderr, "YabaSanshiro: preloaded %llu MB into %s\n", size >> 20, PRELOAD_DIR);
+    s_preload_path = dest;
+    return dest;
+}
+
+void cd_preload_release() {
+    if (!s_preload_path.empty())
+        unlink(s_preload_path.c_str());
+    s_preload_path.clear();
+}
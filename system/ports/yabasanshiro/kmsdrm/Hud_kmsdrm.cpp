@@ -0,0 +1,395 @@
+// Performance HUD for the kmsdrm port.
+//
+// Sampled twice a second from the main loop: frame rate and emulated speed,
+// host frame times, time and emulated clock per chip from the core's
+// perfcounters (MSH2, SSH2, VDP1, VDP2 and the SCSP's 68K, whichever thread
+// they run on) with the dynarec's block cache hit rate, CPU time per host
+// thread (--threads moves VDP1/VDP2 drawing to yab-vdp1/yab-vdp2, the SCSP
+// runs on yab-scsp), CPU/GPU clocks and temperatures, and the audio ring's
+// fill level. Shown through the core's OSD and optionally appended to a CSV
+// so runs can be compared afterwards.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "../osdcore.h"
+#include "../perfcounters.h"
+#ifdef YAB_PORT_OSD
+#include "../nanovg/nanovg_osdcore.h"
+#endif
+}
+
+#define HUD_INTERVAL   0.5 // Seconds between samples
+#define HUD_THREADS    4   // Busiest threads shown on screen
+#define HUD_MSG_FRAMES 90  // OSD message lifetime, outlives a few missed samples
+#define HUD_STATS_LINE 10  // Samples per --stats line
+#define HUD_DRIFT_PPM  4500 // Close to the sound core's +-0.5% rate limit
+
+#define CPU_FREQ_PATH "/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq"
+#define GPU_FREQ_PATH "/sys/class/devfreq/fde60000.gpu/cur_freq"
+#define SOC_TEMP_PATH "/sys/class/thermal/thermal_zone0/temp"
+#define GPU_TEMP_PATH "/sys/class/thermal/thermal_zone1/temp"
+
+// Sound_kmsdrm.cpp
+void audio_stats(double *fill_ms, double *min_fill_ms, unsigned *underruns, unsigned *dropped,
+                 int *ratio_ppm);
+
+struct ThreadTime {
+    std::string name;
+    unsigned long long ticks;
+};
+
+static bool s_active = false;  // OSD core in use
+static bool s_visible = false;
+static FILE *s_csv = nullptr;
+static bool s_stats = false;
+
+static int s_cpu_freq_fd = -1;
+static int s_gpu_freq_fd = -1;
+static int s_soc_temp_fd = -1;
+static int s_gpu_temp_fd = -1;
+
+static double s_last_sample = 0.0;
+static double s_last_frame = 0.0;
+static double s_frame_sum = 0.0;
+static double s_frame_max = 0.0;
+static unsigned s_frame_count = 0;
+static unsigned s_last_presented = 0;
+static unsigned long s_last_emulated = 0;
+static std::map<int, ThreadTime> s_threads; // tid -> CPU ticks at the last sample
+static double s_start = 0.0;
+
+// Threads --stats reports on their own, named by corethreads.c
+static const char *const s_worker_names[] = {"yab-vdp1", "yab-vdp2", "yab-scsp"};
+#define HUD_WORKERS 3
+
+static PerfCounters s_perf; // At the last sample
+static const char *const s_chip_names[PERF_CHIP_COUNT] = {"MSH2", "SSH2", "VDP1", "VDP2", "68K"};
+
+// Per chip since the last sample
+struct ChipSample {
+    double pct[PERF_CHIP_COUNT]; // Of one host core
+    double mhz[PERF_CHIP_COUNT]; // Emulated cycles per second, 0 for the VDPs
+    unsigned long long lookups, misses;
+};
+
+// --stats totals since its last line
+struct StatsWindow {
+    unsigned samples;
+    double speed, emu_pct, other_pct;
+    double worker_pct[HUD_WORKERS];
+    double chip_pct[PERF_CHIP_COUNT];
+    double min_audio_ms;
+    unsigned underruns, dropped;
+    int max_ppm;
+};
+static StatsWindow s_window = {};
+
+static long read_fd_long(int fd) {
+    char buf[32];
+    if (fd < 0)
+        return 0;
+
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    return atol(buf);
+}
+
+static int open_sysfs(const char *path) {
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// Percent of one core per thread since the last sample, busiest first
+static std::vector<std::pair<std::string, double>> sample_threads(double elapsed) {
+    std::vector<std::pair<std::string, double>> usage;
+    std::map<int, ThreadTime> current;
+    static const long ticks_per_sec = sysconf(_SC_CLK_TCK);
+    int pid = (int)getpid();
+
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir)
+        return usage;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char path[64], stat[512];
+        snprintf(path, sizeof(path), "/proc/self/task/%s/stat", entry->d_name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        ssize_t n = read(fd, stat, sizeof(stat) - 1);
+        close(fd);
+        if (n <= 0)
+            continue;
+        stat[n] = '\0';
+
+        // "tid (comm) state ..." with utime and stime as fields 14 and 15
+        char *open_paren = strchr(stat, '(');
+        char *close_paren = strrchr(stat, ')');
+        if (!open_paren || !close_paren)
+            continue;
+
+        unsigned long long utime = 0, stime = 0;
+        if (sscanf(close_paren + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                   &utime, &stime) != 2)
+            continue;
+
+        int tid = atoi(entry->d_name);
+        ThreadTime &t = current[tid];
+        t.name = tid == pid ? "emu" : std::string(open_paren + 1, close_paren);
+        t.ticks = utime + stime;
+
+        auto last = s_threads.find(tid);
+        if (last != s_threads.end() && elapsed > 0.0) {
+            double pct = (t.ticks - last->second.ticks) * 100.0 / (ticks_per_sec * elapsed);
+            if (pct >= 0.5)
+                usage.emplace_back(t.name, pct);
+        }
+    }
+    closedir(dir);
+
+    s_threads.swap(current);
+    std::sort(usage.begin(), usage.end(),
+              [](const std::pair<std::string, double> &a,
+                 const std::pair<std::string, double> &b) { return a.second > b.second; });
+    return usage;
+}
+
+static ChipSample sample_chips(double elapsed) {
+    ChipSample sample = {};
+    PerfCounters now;
+    PerfCountersRead(&now);
+
+    for (int i = 0; i < PERF_CHIP_COUNT && elapsed > 0.0; i++) {
+        sample.pct[i] = (now.chip[i].ns - s_perf.chip[i].ns) / 1e7 / elapsed;
+        sample.mhz[i] = (now.chip[i].cycles - s_perf.chip[i].cycles) / 1e6 / elapsed;
+    }
+    sample.lookups = now.block_lookups - s_perf.block_lookups;
+    sample.misses = now.block_misses - s_perf.block_misses;
+
+    s_perf = now;
+    return sample;
+}
+
+// Audio is in sync while the sound core's rate control holds the ring near its
+// target: no underruns or dropped frames, and the correction never close to
+// its limit. Emulated speed alone doesn't show that, the SCSP can run at 100%
+// of emulated time while the host clock drifts away from it.
+static void print_stats() {
+    const StatsWindow &w = s_window;
+    bool in_sync = w.underruns == 0 && w.dropped == 0 && w.max_ppm < HUD_DRIFT_PPM;
+    fprintf(stderr, "YabaSanshiro: %.0f%% speed, CPU emu %.0f%% vdp1 %.0f%% vdp2 %.0f%% scsp %.0f%% "
+                    "other %.0f%%, chips msh2 %.0f%% ssh2 %.0f%% vdp1 %.0f%% vdp2 %.0f%% 68k %.0f%%, "
+                    "audio min %.0f ms max %d ppm %u xrun %u dropped, %s\n",
+            w.speed / w.samples, w.emu_pct / w.samples, w.worker_pct[0] / w.samples,
+            w.worker_pct[1] / w.samples, w.worker_pct[2] / w.samples, w.other_pct / w.samples,
+            w.chip_pct[PERF_MSH2] / w.samples, w.chip_pct[PERF_SSH2] / w.samples,
+            w.chip_pct[PERF_VDP1] / w.samples, w.chip_pct[PERF_VDP2] / w.samples,
+            w.chip_pct[PERF_M68K] / w.samples, w.min_audio_ms, w.max_ppm, w.underruns, w.dropped,
+            in_sync ? "audio in sync" : "AUDIO DRIFTING");
+    s_window = {};
+}
+
+// Returns the OSD core to init the emulator with
+int hud_init(bool visible, const char *csv_path, bool stats) {
+    s_cpu_freq_fd = open_sysfs(CPU_FREQ_PATH);
+    s_gpu_freq_fd = open_sysfs(GPU_FREQ_PATH);
+    s_soc_temp_fd = open_sysfs(SOC_TEMP_PATH);
+    s_gpu_temp_fd = open_sysfs(GPU_TEMP_PATH);
+
+    if (csv_path && csv_path[0]) {
+        bool empty = access(csv_path, F_OK) != 0;
+        s_csv = fopen(csv_path, "a");
+        if (!s_csv)
+            fprintf(stderr, "HUD: could not open %s: %s\n", csv_path, strerror(errno));
+        else if (empty)
+            fprintf(s_csv, "time_s,fps,speed_pct,frame_ms_avg,frame_ms_max,cpu_mhz,gpu_mhz,"
+                           "soc_temp_c,gpu_temp_c,emu_cpu_pct,other_cpu_pct,audio_ms,audio_min_ms,"
+                           "audio_underruns,audio_dropped,audio_rate_ppm,msh2_mhz,msh2_pct,ssh2_mhz,"
+                           "ssh2_pct,vdp1_pct,vdp2_pct,m68k_mhz,m68k_pct,block_lookups,block_misses,"
+                           "threads\n");
+    }
+
+    s_visible = visible;
+    s_stats = stats;
+    PerfCountersEnable(s_visible || s_csv || s_stats);
+#if defined(YAB_PORT_OSD) && defined(HAVE_VULKAN)
+    s_active = true;
+    return OSDNnovgVulkan.id;
+#else
+    s_active = false;
+    return OSDCORE_DUMMY;
+#endif
+}
+
+static void apply_visibility() {
+    if (!s_active)
+        return;
+
+    OSDSetVisible(OSDMSG_FPS, s_visible);
+    OSDSetVisible(OSDMSG_STATUS, s_visible);
+    OSDSetVisible(OSDMSG_DEBUG, s_visible);
+}
+
+void hud_toggle() {
+    s_visible = !s_visible;
+    PerfCountersEnable(s_visible || s_csv || s_stats);
+    apply_visibility();
+    fprintf(stderr, "HUD: %s\n", s_visible ? "on" : "off");
+}
+
+// Called once per main loop iteration, i.e. once per emulated frame
+void hud_frame(double now, unsigned long emulated_frames, unsigned presented_frames,
+               double emulated_hz) {
+    if (s_start == 0.0) {
+        s_start = s_last_sample = s_last_frame = now;
+        s_last_emulated = emulated_frames;
+        s_last_presented = presented_frames;
+        apply_visibility();
+        sample_threads(0.0);
+        sample_chips(0.0);
+        return;
+    }
+
+    double frame = now - s_last_frame;
+    s_last_frame = now;
+    s_frame_sum += frame;
+    s_frame_max = std::max(s_frame_max, frame);
+    s_frame_count++;
+
+    double elapsed = now - s_last_sample;
+    if (elapsed < HUD_INTERVAL || (!s_visible && !s_csv && !s_stats))
+        return;
+
+    double fps = (presented_frames - s_last_presented) / elapsed;
+    double speed = (emulated_frames - s_last_emulated) / elapsed / emulated_hz * 100.0;
+    double frame_avg = s_frame_count ? s_frame_sum / s_frame_count * 1000.0 : 0.0;
+    double frame_max = s_frame_max * 1000.0;
+    long cpu_mhz = read_fd_long(s_cpu_freq_fd) / 1000;
+    long gpu_mhz = read_fd_long(s_gpu_freq_fd) / 1000000;
+    double soc_temp = read_fd_long(s_soc_temp_fd) / 1000.0;
+    double gpu_temp = read_fd_long(s_gpu_temp_fd) / 1000.0;
+    std::vector<std::pair<std::string, double>> threads = sample_threads(elapsed);
+    double audio_ms, audio_min_ms;
+    unsigned underruns, dropped;
+    int rate_ppm;
+    audio_stats(&audio_ms, &audio_min_ms, &underruns, &dropped, &rate_ppm);
+    ChipSample chips = sample_chips(elapsed);
+
+    double emu_pct = 0.0, other_pct = 0.0, worker_pct[HUD_WORKERS] = {};
+    std::string split;
+    for (size_t i = 0; i < threads.size(); i++) {
+        int worker = 0;
+        while (worker < HUD_WORKERS && threads[i].first != s_worker_names[worker])
+            worker++;
+
+        if (threads[i].first == "emu")
+            emu_pct = threads[i].second;
+        else if (worker < HUD_WORKERS)
+            worker_pct[worker] += threads[i].second;
+        else
+            other_pct += threads[i].second;
+
+        if (i < HUD_THREADS) {
+            char part[48];
+            snprintf(part, sizeof(part), "%s%s %.0f%%", split.empty() ? "" : "  ",
+                     threads[i].first.c_str(), threads[i].second);
+            split += part;
+        }
+    }
+
+    // The VDPs have no clock of their own to show, the dynarec's hit rate
+    // only once it has looked a block up
+    std::string chip_line;
+    for (int i = 0; i < PERF_CHIP_COUNT; i++) {
+        char part[48];
+        if (chips.mhz[i] > 0.0)
+            snprintf(part, sizeof(part), "%s%s %.1f MHz %.0f%%", i ? "  " : "", s_chip_names[i],
+                     chips.mhz[i], chips.pct[i]);
+        else
+            snprintf(part, sizeof(part), "%s%s %.0f%%", i ? "  " : "", s_chip_names[i], chips.pct[i]);
+        chip_line += part;
+    }
+    if (chips.lookups > 0) {
+        char part[64];
+        snprintf(part, sizeof(part), "  blocks %.1f%% hit %llu miss",
+                 (chips.lookups - chips.misses) * 100.0 / chips.lookups, chips.misses);
+        chip_line += part;
+    }
+
+    if (s_visible) {
+        OSDPushMessage(OSDMSG_FPS, HUD_MSG_FRAMES, "%s", chip_line.c_str());
+        OSDPushMessage(OSDMSG_STATUS, HUD_MSG_FRAMES,
+                       "%.1f fps %.0f%%  %.1f/%.1f ms  CPU %ld MHz  GPU %ld MHz  %.0f/%.0f C",
+                       fps, speed, frame_avg, frame_max, cpu_mhz, gpu_mhz, soc_temp, gpu_temp);
+        OSDPushMessage(OSDMSG_DEBUG, HUD_MSG_FRAMES, "%s  audio %.0f/%.0f ms %+d ppm %u xrun",
+                       split.c_str(), audio_ms, audio_min_ms, rate_ppm, underruns);
+    }
+
+    if (s_stats) {
+        if (s_window.samples == 0 || audio_min_ms < s_window.min_audio_ms)
+            s_window.min_audio_ms = audio_min_ms;
+        s_window.samples++;
+        s_window.speed += speed;
+        s_window.emu_pct += emu_pct;
+        s_window.other_pct += other_pct;
+        for (int i = 0; i < HUD_WORKERS; i++)
+            s_window.worker_pct[i] += worker_pct[i];
+        for (int i = 0; i < PERF_CHIP_COUNT; i++)
+            s_window.chip_pct[i] += chips.pct[i];
+        s_window.underruns += underruns;
+        s_window.dropped += dropped;
+        s_window.max_ppm = std::max(s_window.max_ppm, std::abs(rate_ppm));
+        if (s_window.samples >= HUD_STATS_LINE)
+            print_stats();
+    }
+
+    if (s_csv) {
+        fprintf(s_csv, "%.1f,%.2f,%.1f,%.2f,%.2f,%ld,%ld,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%u,%u,%d,"
+                       "%.2f,%.1f,%.2f,%.1f,%.1f,%.1f,%.2f,%.1f,%llu,%llu,\"",
+                now - s_start, fps, speed, frame_avg, frame_max, cpu_mhz, gpu_mhz,
+                soc_temp, gpu_temp, emu_pct, other_pct, audio_ms, audio_min_ms, underruns, dropped,
+                rate_ppm, chips.mhz[PERF_MSH2], chips.pct[PERF_MSH2], chips.mhz[PERF_SSH2],
+                chips.pct[PERF_SSH2], chips.pct[PERF_VDP1], chips.pct[PERF_VDP2],
+                chips.mhz[PERF_M68K], chips.pct[PERF_M68K], chips.lookups, chips.misses);
+        for (size_t i = 0; i < threads.size(); i++)
+            fprintf(s_csv, "%s%s:%.1f", i ? ";" : "", threads[i].first.c_str(), threads[i].second);
+        fprintf(s_csv, "\"\n");
+        fflush(s_csv);
+    }
+
+    s_last_sample = now;
+    s_last_emulated = emulated_frames;
+    s_last_presented = presented_frames;
+    s_frame_sum = s_frame_max = 0.0;
+    s_frame_count = 0;
+}
+
+void hud_shutdown() {
+    if (s_csv)
+        fclose(s_csv);
+    s_csv = nullptr;
+
+    int *fds[] = {&s_cpu_freq_fd, &s_gpu_freq_fd, &s_soc_temp_fd, &s_gpu_temp_fd};
+    for (int *fd : fds) {
+        if (*fd >= 0)
+            close(*fd);
+        *fd = -1;
+    }
+}
@@ -0,0 +1,248 @@
+// Persistent per-game VkPipelineCache for the kmsdrm port.
+//
+// The core creates its pipelines without a cache, so device creation, pipeline
+// creation and device teardown are interposed here: the game's cache file is
+// handed to the driver as soon as the device exists (well before the first
+// frame), substituted wherever the core passes VK_NULL_HANDLE, and written
+// back from a background thread while new pipelines keep appearing.
+
+#include <vulkan/vulkan.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Set by main.cpp before the renderer is created, empty disables the cache
+std::string g_pipeline_cache_path;
+
+#define PCACHE_MAGIC    0x4B4D4350u // "PCMK"
+#define PCACHE_VERSION  1
+#define PCACHE_SAVE_INTERVAL std::chrono::seconds(10)
+
+struct PipelineCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    uint32_t dataSize;
+    uint32_t checksum;
+};
+
+static VkDevice s_device = VK_NULL_HANDLE;
+static VkPhysicalDeviceProperties s_props;
+static VkPipelineCache s_cache = VK_NULL_HANDLE;
+static std::atomic<unsigned> s_created(0); // Pipelines created through s_cache
+static unsigned s_saved = 0;               // s_created at the last save
+
+static std::thread s_saver;
+static std::mutex s_lock;
+static std::condition_variable s_cv;
+static bool s_stop = false;
+
+template <typename T>
+static T real_fn(const char *name) {
+    return (T)dlsym(RTLD_NEXT, name);
+}
+
+static uint32_t fnv1a(const uint8_t *data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+// A cache from another driver build or GPU is dropped rather than handed
+// to the driver, some of which don't validate it themselves
+static bool load_cache_file(std::vector<uint8_t> &data) {
+    FILE *fp = fopen(g_pipeline_cache_path.c_str(), "rb");
+    if (!fp)
+        return false;
+
+    PipelineCacheHeader hdr;
+    bool ok = fread(&hdr, sizeof(hdr), 1, fp) == 1 &&
+              hdr.magic == PCACHE_MAGIC && hdr.version == PCACHE_VERSION &&
+              hdr.vendorID == s_props.vendorID && hdr.deviceID == s_props.deviceID &&
+              hdr.driverVersion == s_props.driverVersion &&
+              memcmp(hdr.pipelineCacheUUID, s_props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    if (ok) {
+        data.resize(hdr.dataSize);
+        ok = fread(data.data(), 1, data.size(), fp) == data.size() &&
+             fnv1a(data.data(), data.size()) == hdr.checksum;
+    }
+    fclose(fp);
+
+    if (!ok) {
+        fprintf(stderr, "Pipeline cache: %s is stale, starting fresh\n", g_pipeline_cache_path.c_str());
+        data.clear();
+    }
+    return ok;
+}
+
+static void mkdir_parents(const std::string &path) {
+    for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+        mkdir(path.substr(0, pos).c_str(), 0755);
+}
+
+static bool save_cache_file() {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(s_device, s_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+        return false;
+
+    std::vector<uint8_t> data(size);
+    if (vkGetPipelineCacheData(s_device, s_cache, &size, data.data()) != VK_SUCCESS)
+        return false;
+    data.resize(size);
+
+    PipelineCacheHeader hdr = {};
+    hdr.magic = PCACHE_MAGIC;
+    hdr.version = PCACHE_VERSION;
+    hdr.vendorID = s_props.vendorID;
+    hdr.deviceID = s_props.deviceID;
+    hdr.driverVersion = s_props.driverVersion;
+    memcpy(hdr.pipelineCacheUUID, s_props.pipelineCacheUUID, VK_UUID_SIZE);
+    hdr.dataSize = (uint32_t)data.size();
+    hdr.checksum = fnv1a(data.data(), data.size());
+
+    // exFAT: write aside, fsync, then rename over the old file
+    std::string tmp = g_pipeline_cache_path + ".tmp";
+    mkdir_parents(tmp);
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Pipeline cache: could not write %s: %s\n", tmp.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool ok = write(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr) &&
+              write(fd, data.data(), data.size()) == (ssize_t)data.size() &&
+              fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), g_pipeline_cache_path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    fprintf(stderr, "Pipeline cache: saved %zu bytes\n", data.size());
+    return true;
+}
+
+static void saver_main() {
+    std::unique_lock<std::mutex> lock(s_lock);
+    while (!s_stop) {
+        s_cv.wait_for(lock, PCACHE_SAVE_INTERVAL);
+        if (s_stop)
+            break;
+
+        unsigned created = s_created.load();
+        if (created != s_saved && save_cache_file())
+            s_saved = created;
+    }
+}
+
+extern "C" VKAPI_ATTR VkResult VKAPI_CALL vkCreateDevice(
+    VkPhysicalDevice gpu, const VkDeviceCreateInfo *info,
+    const VkAllocationCallbacks *alloc, VkDevice *device) {
+    static PFN_vkCreateDevice real = real_fn<PFN_vkCreateDevice>("vkCreateDevice");
+    if (!real)
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    VkResult result = real(gpu, info, alloc, device);
+    if (result != VK_SUCCESS || g_pipeline_cache_path.empty() || s_device != VK_NULL_HANDLE)
+        return result;
+
+    s_device = *device;
+    vkGetPhysicalDeviceProperties(gpu, &s_props);
+
+    std::vector<uint8_t> data;
+    bool loaded = load_cache_file(data);
+
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(s_device, &cacheInfo, nullptr, &s_cache) != VK_SUCCESS) {
+        // Driver refused the blob, try again without it
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        loaded = false;
+        if (vkCreatePipelineCache(s_device, &cacheInfo, nullptr, &s_cache) != VK_SUCCESS)
+            s_cache = VK_NULL_HANDLE;
+    }
+
+    if (s_cache != VK_NULL_HANDLE) {
+        fprintf(stderr, "Pipeline cache: %s (%zu bytes)\n",
+                loaded ? "loaded" : "created", loaded ? data.size() : (size_t)0);
+        s_stop = false;
+        s_saver = std::thread(saver_main);
+    }
+    return result;
+}
+
+extern "C" VKAPI_ATTR VkResult VKAPI_CALL vkCreateGraphicsPipelines(
+    VkDevice device, VkPipelineCache cache, uint32_t count,
+    const VkGraphicsPipelineCreateInfo *infos, const VkAllocationCallbacks *alloc,
+    VkPipeline *pipelines) {
+    static PFN_vkCreateGraphicsPipelines real =
+        real_fn<PFN_vkCreateGraphicsPipelines>("vkCreateGraphicsPipelines");
+    if (!real)
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    if (cache == VK_NULL_HANDLE && device == s_device && s_cache != VK_NULL_HANDLE) {
+        cache = s_cache;
+        s_created += count;
+    }
+    return real(device, cache, count, infos, alloc, pipelines);
+}
+
+extern "C" VKAPI_ATTR VkResult VKAPI_CALL vkCreateComputePipelines(
+    VkDevice device, VkPipelineCache cache, uint32_t count,
+    const VkComputePipelineCreateInfo *infos, const VkAllocationCallbacks *alloc,
+    VkPipeline *pipelines) {
+    static PFN_vkCreateComputePipelines real =
+        real_fn<PFN_vkCreateComputePipelines>("vkCreateComputePipelines");
+    if (!real)
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    if (cache == VK_NULL_HANDLE && device == s_device && s_cache != VK_NULL_HANDLE) {
+        cache = s_cache;
+        s_created += count;
+    }
+    return real(device, cache, count, infos, alloc, pipelines);
+}
+
+extern "C" VKAPI_ATTR void VKAPI_CALL vkDestroyDevice(
+    VkDevice device, const VkAllocationCallbacks *alloc) {
+    static PFN_vkDestroyDevice real = real_fn<PFN_vkDestroyDevice>("vkDestroyDevice");
+
+    if (device == s_device && s_cache != VK_NULL_HANDLE) {
+        {
+            std::lock_guard<std::mutex> lock(s_lock);
+            s_stop = true;
+        }
+        s_cv.notify_all();
+        if (s_saver.joinable())
+            s_saver.join();
+
+        if (s_created.load() != s_saved)
+            save_cache_file();
+        vkDestroyPipelineCache(s_device, s_cache, nullptr);
+        s_cache = VK_NULL_HANDLE;
+        s_device = VK_NULL_HANDLE;
+    }
+
+    if (real)
+        real(device, alloc);
+}
@@ -0,0 +1,281 @@
+// Save states for the kmsdrm port, kept off the emulation thread's I/O path.
+//
+// A save serializes the machine into an in-memory snapshot (memfd) and hands
+// it to a writer thread, which zstd-compresses it and writes it out. Pending
+// snapshots of the same slot are coalesced, and a batch is synced once with
+// syncfs() before the renames. The quick slot never touches the SD card.
+// Loads prefer the newest snapshot still in memory, otherwise they
+// decompress straight out of an mmap of the state file.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "../memory.h"
+}
+
+// zstd comes in statically with libchdr, its header just isn't on the
+// port's include path
+extern "C" {
+size_t ZSTD_compressBound(size_t srcSize);
+size_t ZSTD_compress(void *dst, size_t dstCapacity, const void *src, size_t srcSize, int level);
+size_t ZSTD_decompress(void *dst, size_t dstCapacity, const void *src, size_t compressedSize);
+unsigned long long ZSTD_getFrameContentSize(const void *src, size_t srcSize);
+unsigned ZSTD_isError(size_t code);
+}
+
+#define STATE_ZSTD_LEVEL 3
+#define STATE_MAX_SIZE   (64u << 20) // Sanity bound for a frame's content size
+
+typedef std::shared_ptr<std::vector<uint8_t>> Snapshot;
+
+struct WriteJob {
+    int slot;
+    Snapshot data;
+};
+
+static std::string s_dir;
+static std::string s_game;
+static Snapshot s_quick;
+
+static std::thread s_writer;
+static std::mutex s_lock;
+static std::condition_variable s_cv;
+static std::vector<WriteJob> s_pending; // Guarded by s_lock, at most one per slot
+static std::vector<WriteJob> s_writing; // Guarded by s_lock, the batch being written
+static bool s_stop = false;
+
+static std::string slot_path(int slot) {
+    return s_dir + "/" + s_game + "." + std::to_string(slot) + ".yss.zst";
+}
+
+static Snapshot take_snapshot() {
+    int fd = memfd_create("yabause-state", MFD_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    FILE *fp = fdopen(fd, "w+b");
+    if (!fp) {
+        close(fd);
+        return nullptr;
+    }
+
+    Snapshot snap;
+    if (YabSaveStateStream(fp) == 0 && fflush(fp) == 0) {
+        off_t size = lseek(fd, 0, SEEK_END);
+        if (size > 0) {
+            snap = std::make_shared<std::vector<uint8_t>>((size_t)size);
+            if (pread(fd, snap->data(), snap->size(), 0) != (ssize_t)snap->size())
+                snap.reset();
+        }
+    }
+    fclose(fp);
+    return snap;
+}
+
+static bool restore_snapshot(const uint8_t *data, size_t size) {
+    FILE *fp = fmemopen((void *)data, size, "rb");
+    if (!fp)
+        return false;
+
+    bool ok = YabLoadStateStream(fp) == 0;
+    fclose(fp);
+    return ok;
+}
+
+// Compresses and writes one slot to <path>.tmp, returns the open fd or -1
+static int write_compressed(const WriteJob &job, const std::string &tmp) {
+    std::vector<uint8_t> packed(ZSTD_compressBound(job.data->size()));
+    size_t size = ZSTD_compress(packed.data(), packed.size(), job.data->data(), job.data->size(),
+                                STATE_ZSTD_LEVEL);
+    if (ZSTD_isError(size))
+        return -1;
+
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+
+    const uint8_t *p = packed.data();
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            close(fd);
+            unlink(tmp.c_str());
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return fd;
+}
+
+static void writer_main() {
+    std::unique_lock<std::mutex> lock(s_lock);
+    while (true) {
+        s_cv.wait(lock, [] { return s_stop || !s_pending.empty(); });
+        if (s_pending.empty())
+            break; // Stopping with nothing left to write
+
+        s_writing.swap(s_pending);
+        std::vector<WriteJob> batch = s_writing;
+        lock.unlock();
+
+        mkdir(s_dir.c_str(), 0755);
+
+        std::vector<int> fds;
+        std::vector<int> slots;
+        for (const WriteJob &job : batch) {
+            int fd = write_compressed(job, slot_path(job.slot) + ".tmp");
+            if (fd < 0) {
+                fprintf(stderr, "YabaSanshiro: could not write state slot %d\n", job.slot);
+                continue;
+            }
+            fds.push_back(fd);
+            slots.push_back(job.slot);
+        }
+
+        // One sync for the whole batch, then swap the files in
+        if (!fds.empty())
+            syncfs(fds[0]);
+        for (size_t i = 0; i < fds.size(); i++) {
+            close(fds[i]);
+            std::string path = slot_path(slots[i]);
+            if (rename((path + ".tmp").c_str(), path.c_str()) == 0)
+                fprintf(stderr, "YabaSanshiro: state slot %d written\n", slots[i]);
+        }
+        if (!fds.empty()) {
+            int dirfd = open(s_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dirfd >= 0) {
+                fsync(dirfd);
+                close(dirfd);
+            }
+        }
+
+        lock.lock();
+        s_writing.clear();
+    }
+}
+
+void savestate_init(const char *dir, const char *disc_path) {
+    s_dir = dir;
+    const char *name = strrchr(disc_path, '/');
+    s_game = name ? name + 1 : disc_path;
+    if (s_game.empty())
+        s_game = "unknown";
+
+    s_stop = false;
+    s_writer = std::thread(writer_main);
+}
+
+// Only the snapshot happens on the calling thread, the writer does the rest
+bool savestate_save(int slot) {
+    Snapshot snap = take_snapshot();
+    if (!snap) {
+        fprintf(stderr, "YabaSanshiro: could not take snapshot\n");
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s_lock);
+    for (WriteJob &job : s_pending) {
+        if (job.slot == slot) {
+            job.data = snap;
+            return true;
+        }
+    }
+    s_pending.push_back({slot, snap});
+    s_cv.notify_one();
+    return true;
+}
+
+static bool load_from_file(int slot) {
+    std::string path = slot_path(slot);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    bool ok = false;
+    unsigned long long size = ZSTD_getFrameContentSize(map, st.st_size);
+    if (size > 0 && size <= STATE_MAX_SIZE) {
+        std::vector<uint8_t> data((size_t)size);
+        size_t n = ZSTD_decompress(data.data(), data.size(), map, st.st_size);
+        ok = !ZSTD_isError(n) && n == data.size() && restore_snapshot(data.data(), n);
+    }
+    munmap(map, st.st_size);
+    return ok;
+}
+
+bool savestate_load(int slot) {
+    // A snapshot the writer hasn't finished with is newer than the file
+    Snapshot pending;
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        for (const WriteJob &job : s_writing) {
+            if (job.slot == slot)
+                pending = job.data;
+        }
+        for (const WriteJob &job : s_pending) {
+            if (job.slot == slot)
+                pending = job.data;
+        }
+    }
+    if (pending)
+        return restore_snapshot(pending->data(), pending->size());
+
+    if (load_from_file(slot))
+        return true;
+
+    // Uncompressed states from before the async writer
+    return YabLoadStateSlot(s_dir.c_str(), (unsigned char)slot) == 0;
+}
+
+// RAM only, gone when the emulator exits
+bool savestate_quick_save() {
+    Snapshot snap = take_snapshot();
+    if (snap)
+        s_quick = snap;
+    return snap != nullptr;
+}
+
+bool savestate_quick_load() {
+    return s_quick && restore_snapshot(s_quick->data(), s_quick->size());
+}
+
+// Waits for pending writes
+void savestate_shutdown() {
+    if (!s_writer.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        s_stop = true;
+    }
+    s_cv.notify_all();
+    s_writer.join();
+    s_quick.reset();
+}
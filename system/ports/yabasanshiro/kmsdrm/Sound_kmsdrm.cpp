@@ -0,0 +1,231 @@
+// Sound core for the kmsdrm port.
+//
+// The SCSP hands its 32-bit mix to UpdateAudio, which clamps it straight
+// into a single-producer/single-consumer ring of packed stereo 16-bit
+// frames; the SDL callback reads the ring directly into the device buffer.
+// There is no staging buffer and no lock between the two threads.
+//
+// The device is opened with an explicit, small buffer. Instead of letting
+// frame-time jitter drain the ring into an underrun, the callback reads it
+// at a slightly adjusted rate (up to +-0.5%, linear interpolation) that
+// steers the fill level back to the target. Fill level, underruns and the
+// current rate are reported to the HUD.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include <algorithm>
+#include <atomic>
+
+#include <SDL.h>
+
+extern "C" {
+#include "../scsp.h"
+#include "../corethreads.h"
+}
+
+// Device buffer in frames, set by main.cpp (--audio-buffer). The ring is
+// kept around AUDIO_TARGET_BUFFERS device buffers full.
+int g_audio_buffer_frames = 512;
+
+#define SNDCORE_KMSDRM       20
+#define AUDIO_RATE           44100
+#define AUDIO_RING_FRAMES    8192 // Power of two
+#define AUDIO_TARGET_BUFFERS 2
+#define AUDIO_MAX_ADJUST     0.005 // Largest rate change
+#define AUDIO_ADJUST_GAIN    0.01  // Rate change per unit of relative fill error
+
+static uint32_t s_ring[AUDIO_RING_FRAMES]; // Left in the low half, right in the high
+static std::atomic<uint32_t> s_write(0);   // Frames written, SCSP thread only
+static std::atomic<uint32_t> s_read(0);    // Frames consumed, SDL callback only
+static SDL_AudioDeviceID s_device = 0;
+static uint32_t s_target = 0;              // Frames
+static double s_phase = 0.0;               // Fraction between ring[read] and ring[read + 1]
+static int16_t s_last[2] = {0, 0};         // Held through an underrun
+static bool s_primed = false;              // Silence until the ring first reaches the target
+static std::atomic<bool> s_muted(false);
+static std::atomic<int> s_volume(SDL_MIX_MAXVOLUME);
+static std::atomic<int> s_ratio_ppm(0);    // Last rate adjustment
+
+// Reset whenever the HUD reads them
+static std::atomic<uint32_t> s_min_fill(UINT32_MAX);
+static std::atomic<uint32_t> s_underruns(0);
+static std::atomic<uint32_t> s_dropped(0);
+
+static inline int16_t clamp16(int32_t v) {
+    return (int16_t)std::min(std::max(v, -32768), 32767);
+}
+
+static inline int16_t left(uint32_t frame) { return (int16_t)(frame & 0xffff); }
+static inline int16_t right(uint32_t frame) { return (int16_t)(frame >> 16); }
+
+static void audio_callback(void *, Uint8 *stream, int len) {
+    int16_t *out = (int16_t *)stream;
+    int frames = len / (int)(2 * sizeof(int16_t));
+
+    uint32_t read = s_read.load(std::memory_order_relaxed);
+    uint32_t fill = s_write.load(std::memory_order_acquire) - read;
+    if (!s_primed && fill < s_target) {
+        memset(stream, 0, len);
+        return;
+    }
+    s_primed = true;
+    if (fill < s_min_fill.load(std::memory_order_relaxed))
+        s_min_fill.store(fill, std::memory_order_relaxed);
+
+    // Above the target: read a little faster, below it: a little slower
+    double error = s_target ? ((double)fill - s_target) / s_target : 0.0;
+    double ratio = 1.0 + std::min(std::max(error * AUDIO_ADJUST_GAIN, -AUDIO_MAX_ADJUST),
+                                  AUDIO_MAX_ADJUST);
+    s_ratio_ppm.store((int)((ratio - 1.0) * 1e6), std::memory_order_relaxed);
+
+    int volume = s_muted.load(std::memory_order_relaxed) ? 0 : s_volume.load(std::memory_order_relaxed);
+    bool starved = false;
+    for (int i = 0; i < frames; i++) {
+        // Interpolation needs the frame after the current one too
+        if (fill < 2) {
+            starved = true;
+            out[2 * i] = s_last[0];
+            out[2 * i + 1] = s_last[1];
+            continue;
+        }
+
+        uint32_t a = s_ring[read & (AUDIO_RING_FRAMES - 1)];
+        uint32_t b = s_ring[(read + 1) & (AUDIO_RING_FRAMES - 1)];
+        int32_t l = left(a) + (int32_t)((left(b) - left(a)) * s_phase);
+        int32_t r = right(a) + (int32_t)((right(b) - right(a)) * s_phase);
+        s_last[0] = (int16_t)(l * volume / SDL_MIX_MAXVOLUME);
+        s_last[1] = (int16_t)(r * volume / SDL_MIX_MAXVOLUME);
+        out[2 * i] = s_last[0];
+        out[2 * i + 1] = s_last[1];
+
+        s_phase += ratio;
+        uint32_t advance = (uint32_t)s_phase;
+        advance = std::min(advance, fill - 1);
+        s_phase -= advance;
+        read += advance;
+        fill -= advance;
+    }
+
+    if (starved)
+        s_underruns.fetch_add(1, std::memory_order_relaxed);
+    s_read.store(read, std::memory_order_release);
+}
+
+static int snd_init(void) {
+    if (!SDL_WasInit(SDL_INIT_AUDIO) && SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        fprintf(stderr, "YabaSanshiro: audio init failed: %s\n", SDL_GetError());
+        return -1;
+    }
+
+    SDL_AudioSpec want = {}, have = {};
+    want.freq = AUDIO_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 2;
+    want.samples = (Uint16)std::min(std::max(g_audio_buffer_frames, 64), AUDIO_RING_FRAMES / 8);
+    want.callback = audio_callback;
+
+    // Any difference in format is SDL's to convert, the buffer size is ours
+    s_device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (!s_device) {
+        fprintf(stderr, "YabaSanshiro: could not open audio: %s\n", SDL_GetError());
+        return -1;
+    }
+
+    s_target = std::min<uint32_t>(have.samples * AUDIO_TARGET_BUFFERS, AUDIO_RING_FRAMES / 2);
+    s_write.store(0);
+    s_read.store(0);
+    s_phase = 0.0;
+    s_primed = false;
+    fprintf(stderr, "YabaSanshiro: audio %d Hz, %d frame buffer, %.1f ms target\n",
+            have.freq, have.samples, s_target * 1000.0 / AUDIO_RATE);
+
+    SDL_PauseAudioDevice(s_device, 0);
+    return 0;
+}
+
+static void snd_deinit(void) {
+    if (s_device)
+        SDL_CloseAudioDevice(s_device);
+    s_device = 0;
+}
+
+static int snd_reset(void) {
+    return 0;
+}
+
+static int snd_change_video_format(int) {
+    return 0;
+}
+
+// Runs on the SCSP thread, the only writer. The core starts that thread, so
+// this is where it gets its name and --thread-cpus pin.
+static void snd_update_audio(u32 *leftchanbuffer, u32 *rightchanbuffer, u32 num_samples) {
+    CoreThreadAttach(CORE_THREAD_SCSP);
+    const int32_t *l = (const int32_t *)leftchanbuffer;
+    const int32_t *r = (const int32_t *)rightchanbuffer;
+    uint32_t write = s_write.load(std::memory_order_relaxed);
+    uint32_t space = AUDIO_RING_FRAMES - (write - s_read.load(std::memory_order_acquire));
+
+    if (num_samples > space) {
+        s_dropped.fetch_add(num_samples - space, std::memory_order_relaxed);
+        num_samples = space;
+    }
+
+    for (u32 i = 0; i < num_samples; i++) {
+        uint16_t lo = (uint16_t)clamp16(l[i]);
+        uint16_t hi = (uint16_t)clamp16(r[i]);
+        s_ring[(write + i) & (AUDIO_RING_FRAMES - 1)] = (uint32_t)hi << 16 | lo;
+    }
+    s_write.store(write + num_samples, std::memory_order_release);
+}
+
+// Lets the core produce up to twice the target, the rate control drains the rest
+static u32 snd_get_audio_space(void) {
+    uint32_t fill = s_write.load(std::memory_order_relaxed) - s_read.load(std::memory_order_acquire);
+    uint32_t limit = s_target * 2;
+    return fill < limit ? limit - fill : 0;
+}
+
+static void snd_mute_audio(void) {
+    s_muted.store(true);
+}
+
+static void snd_unmute_audio(void) {
+    s_muted.store(false);
+}
+
+static void snd_set_volume(int volume) {
+    s_volume.store(std::min(std::max(volume, 0), 100) * SDL_MIX_MAXVOLUME / 100);
+}
+
+// Ring fill now and its low point since the last call, both in ms, plus
+// underrun callbacks, frames dropped on a full ring and the rate adjustment in ppm
+void audio_stats(double *fill_ms, double *min_fill_ms, unsigned *underruns, unsigned *dropped,
+                 int *ratio_ppm) {
+    uint32_t fill = s_write.load(std::memory_order_relaxed) - s_read.load(std::memory_order_relaxed);
+    uint32_t min_fill = s_min_fill.exchange(UINT32_MAX, std::memory_order_relaxed);
+    *fill_ms = fill * 1000.0 / AUDIO_RATE;
+    *min_fill_ms = (min_fill == UINT32_MAX ? fill : min_fill) * 1000.0 / AUDIO_RATE;
+    *underruns = s_underruns.exchange(0, std::memory_order_relaxed);
+    *dropped = s_dropped.exchange(0, std::memory_order_relaxed);
+    *ratio_ppm = s_device ? s_ratio_ppm.load(std::memory_order_relaxed) : 0;
+}
+
+extern "C" {
+SoundInterface_struct SNDKmsdrm = {
+    SNDCORE_KMSDRM,
+    "SDL ring buffer (kmsdrm)",
+    snd_init,
+    snd_deinit,
+    snd_reset,
+    snd_change_video_format,
+    snd_update_audio,
+    snd_get_audio_space,
+    snd_mute_audio,
+    snd_unmute_audio,
+    snd_set_volume,
+};
+}
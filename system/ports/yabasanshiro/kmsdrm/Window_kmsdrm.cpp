@@ -11,6 +11,66 @@
 #include <cstdlib>
 #include <vector>
 
+// Refresh rate of the chosen display mode in mHz, read by the frame pacer
+uint32_t g_display_refresh_mhz = 0;
+
+// Set from the command line before the window is opened
+uint32_t g_display_index = 0;
+uint32_t g_mode_width = 0, g_mode_height = 0, g_mode_refresh = 0; // 0 = pick
+uint32_t g_scanout_width = 0, g_scanout_height = 0;                 // 0 = mode size
+
+// Requested mode if given, otherwise the panel's native size at its highest refresh
+static uint32_t pick_mode(const std::vector<VkDisplayModePropertiesKHR> &modes,
+                          const VkDisplayPropertiesKHR &props)
+{
+    uint32_t want_w = g_mode_width ? g_mode_width : props.physicalResolution.width;
+    uint32_t want_h = g_mode_height ? g_mode_height : props.physicalResolution.height;
+    uint32_t best = UINT32_MAX;
+
+    for (uint32_t i = 0; i < modes.size(); i++) {
+        const VkDisplayModeParametersKHR &p = modes[i].parameters;
+        if (p.visibleRegion.width != want_w || p.visibleRegion.height != want_h)
+            continue;
+        if (g_mode_refresh && (p.refreshRate + 500) / 1000 != g_mode_refresh)
+            continue;
+        if (best == UINT32_MAX || p.refreshRate > modes[best].parameters.refreshRate)
+            best = i;
+    }
+
+    if (best == UINT32_MAX) {
+        if (g_mode_width)
+            fprintf(stderr, "VK_KHR_display: mode %ux%u not available, using default\n",
+                    want_w, want_h);
+        best = 0;
+    }
+    return best;
+}
+
+static bool plane_supports_display(VkPhysicalDevice gpu, uint32_t plane, VkDisplayKHR display)
+{
+    uint32_t supportedCount = 0;
+    vkGetDisplayPlaneSupportedDisplaysKHR(gpu, plane, &supportedCount, nullptr);
+    if (supportedCount == 0)
+        return false;
+
+    std::vector<VkDisplayKHR> supported(supportedCount);
+    vkGetDisplayPlaneSupportedDisplaysKHR(gpu, plane, &supportedCount, supported.data());
+    for (uint32_t j = 0; j < supportedCount; j++) {
+        if (supported[j] == display)
+            return true;
+    }
+    return false;
+}
+
+// Whether the plane can scan out a src-sized image stretched to the full mode
+static bool plane_can_scale(const VkDisplayPlaneCapabilitiesKHR &caps, VkExtent2D src, VkExtent2D dst)
+{
+    return src.width  >= caps.minSrcExtent.width  && src.width  <= caps.maxSrcExtent.width &&
+           src.height >= caps.minSrcExtent.height && src.height <= caps.maxSrcExtent.height &&
+           dst.width  >= caps.minDstExtent.width  && dst.width  <= caps.maxDstExtent.width &&
+           dst.height >= caps.minDstExtent.height && dst.height <= caps.maxDstExtent.height;
+}
+
 void Window::_InitOSWindow()
 {
 }
@@ -39,11 +99,16 @@ void Window::_InitOSSurface()
     std::vector<VkDisplayPropertiesKHR> displayProps(displayCount);
     vkGetPhysicalDeviceDisplayPropertiesKHR(gpu, &displayCount, displayProps.data());
 
-    VkDisplayKHR display = displayProps[0].display;
+    if (g_display_index >= displayCount) {
+        fprintf(stderr, "VK_KHR_display: display %u not found, using 0\n", g_display_index);
+        g_display_index = 0;
+    }
+    const VkDisplayPropertiesKHR &dispProps = displayProps[g_display_index];
+    VkDisplayKHR display = dispProps.display;
     fprintf(stderr, "VK_KHR_display: using display '%s' (%ux%u)\n",
-            displayProps[0].displayName ? displayProps[0].displayName : "(unnamed)",
-            displayProps[0].physicalResolution.width,
-            displayProps[0].physicalResolution.height);
+            dispProps.displayName ? dispProps.displayName : "(unnamed)",
+            dispProps.physicalResolution.width,
+            dispProps.physicalResolution.height);
 
     uint32_t modeCount = 0;
     vkGetDisplayModePropertiesKHR(gpu, display, &modeCount, nullptr);
@@ -56,13 +121,13 @@ void Window::_InitOSSurface()
     std::vector<VkDisplayModePropertiesKHR> modeProps(modeCount);
     vkGetDisplayModePropertiesKHR(gpu, display, &modeCount, modeProps.data());
 
-    VkDisplayModeKHR displayMode = modeProps[0].displayMode;
-    _surface_size_x = modeProps[0].parameters.visibleRegion.width;
-    _surface_size_y = modeProps[0].parameters.visibleRegion.height;
+    const VkDisplayModePropertiesKHR &mode = modeProps[pick_mode(modeProps, dispProps)];
+    VkDisplayModeKHR displayMode = mode.displayMode;
+    VkExtent2D modeExtent = mode.parameters.visibleRegion;
+    g_display_refresh_mhz = mode.parameters.refreshRate;
 
     fprintf(stderr, "VK_KHR_display: mode %ux%u @ %u mHz\n",
-            _surface_size_x, _surface_size_y,
-            modeProps[0].parameters.refreshRate);
+            modeExtent.width, modeExtent.height, mode.parameters.refreshRate);
 
     uint32_t planeCount = 0;
     vkGetPhysicalDeviceDisplayPlanePropertiesKHR(gpu, &planeCount, nullptr);
@@ -75,30 +140,38 @@ void Window::_InitOSSurface()
     std::vector<VkDisplayPlanePropertiesKHR> planeProps(planeCount);
     vkGetPhysicalDeviceDisplayPlanePropertiesKHR(gpu, &planeCount, planeProps.data());
 
+    // A scaled scanout renders a small image and lets the display controller
+    // stretch it to the mode, which saves GPU bandwidth on every frame
+    VkExtent2D scanout = modeExtent;
+    bool want_scaled = g_scanout_width && g_scanout_height &&
+                       (g_scanout_width != modeExtent.width || g_scanout_height != modeExtent.height);
+    if (want_scaled)
+        scanout = { g_scanout_width, g_scanout_height };
+
     uint32_t planeIndex = UINT32_MAX;
     uint32_t planeStackIndex = 0;
+    VkDisplayPlaneCapabilitiesKHR planeCaps = {};
 
-    for (uint32_t i = 0; i < planeCount; i++) {
-        if (planeProps[i].currentDisplay != VK_NULL_HANDLE &&
-            planeProps[i].currentDisplay != display) {
-            continue;
-        }
-
-        uint32_t supportedCount = 0;
-        vkGetDisplayPlaneSupportedDisplaysKHR(gpu, i, &supportedCount, nullptr);
-        if (supportedCount == 0) continue;
-
-        std::vector<VkDisplayKHR> supported(supportedCount);
-        vkGetDisplayPlaneSupportedDisplaysKHR(gpu, i, &supportedCount, supported.data());
-
-        for (uint32_t j = 0; j < supportedCount; j++) {
-            if (supported[j] == display) {
-                planeIndex = i;
-                planeStackIndex = planeProps[i].currentStackIndex;
-                break;
+    // Two passes when scaling: first a plane that can scale, then any plane
+    for (int pass = want_scaled ? 0 : 1; pass < 2 && planeIndex == UINT32_MAX; pass++) {
+        for (uint32_t i = 0; i < planeCount; i++) {
+            if (planeProps[i].currentDisplay != VK_NULL_HANDLE &&
+                planeProps[i].currentDisplay != display) {
+                continue;
             }
+            if (!plane_supports_display(gpu, i, display))
+                continue;
+
+            VkDisplayPlaneCapabilitiesKHR caps = {};
+            vkGetDisplayPlaneCapabilitiesKHR(gpu, displayMode, i, &caps);
+            if (pass == 0 && !plane_can_scale(caps, scanout, modeExtent))
+                continue;
+
+            planeIndex = i;
+            planeStackIndex = planeProps[i].currentStackIndex;
+            planeCaps = caps;
+            break;
         }
-        if (planeIndex != UINT32_MAX) break;
     }
 
     if (planeIndex == UINT32_MAX) {
@@ -107,11 +180,17 @@ void Window::_InitOSSurface()
         return;
     }
 
-    fprintf(stderr, "VK_KHR_display: using plane %u (stack %u)\n",
-            planeIndex, planeStackIndex);
+    if (want_scaled && !plane_can_scale(planeCaps, scanout, modeExtent)) {
+        fprintf(stderr, "VK_KHR_display: no plane can scale %ux%u to %ux%u, using native\n",
+                scanout.width, scanout.height, modeExtent.width, modeExtent.height);
+        scanout = modeExtent;
+    }
 
-    VkDisplayPlaneCapabilitiesKHR planeCaps = {};
-    vkGetDisplayPlaneCapabilitiesKHR(gpu, displayMode, planeIndex, &planeCaps);
+    _surface_size_x = scanout.width;
+    _surface_size_y = scanout.height;
+
+    fprintf(stderr, "VK_KHR_display: using plane %u (stack %u), scanout %ux%u\n",
+            planeIndex, planeStackIndex, _surface_size_x, _surface_size_y);
 
     VkDisplayPlaneAlphaFlagBitsKHR alphaMode = VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR;
     if (planeCaps.supportedAlpha & VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR) {
@@ -3,8 +3,16 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
 #include <unistd.h>
 #include <signal.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
 
 #include <SDL.h>
 
@@ -24,6 +32,8 @@ extern "C" {
 #include "../vdp1.h"
 #include "../vdp2.h"
 #include "../memory.h"
+#include "../corethreads.h"
+#include "../perfcounters.h"
 }
 
 #ifdef HAVE_LIBSDL
@@ -62,7 +72,7 @@ M68K_struct *M68KCoreList[] = {
     &M68KMusashi,
 #endif
 #ifdef HAVE_C68K
-    &M68KC68K,
+    &M68KCorePerf, // M68KC68K, wrapped in main()
 #endif
     NULL
 };
@@ -71,7 +81,7 @@ SH2Interface_struct *SH2CoreList[] = {
     &SH2Interpreter,
     &SH2DebugInterpreter,
 #ifdef DYNAREC_DEVMIYAX
-    &SH2Dyn,
+    &SH2CorePerf, // SH2Dyn, wrapped in main()
 #endif
 #ifdef SH2_DYNAREC
     &SH2Dynarec,
@@ -96,8 +106,13 @@ CDInterface *CDCoreList[] = {
     NULL
 };
 
+// Low-latency ring buffer core, Sound_kmsdrm.cpp
+extern "C" SoundInterface_struct SNDKmsdrm;
+extern int g_audio_buffer_frames;
+
 SoundInterface_struct *SNDCoreList[] = {
     &SNDDummy,
+    &SNDKmsdrm,
 #ifdef HAVE_LIBSDL
     &SNDSDL,
 #endif
@@ -107,7 +122,7 @@ SoundInterface_struct *SNDCoreList[] = {
 VideoInterface_struct *VIDCoreList[] = {
     &VIDDummy,
 #ifdef HAVE_VULKAN
-    &CVIDVulkan,
+    &VIDCoreThreaded, // CVIDVulkan, wrapped in main()
 #endif
 #ifdef HAVE_LIBGL
     &VIDOGL,
@@ -128,6 +143,112 @@ OSD_struct *OSDCoreList[] = {
 
 static volatile int g_running = 1;
 
+// Threaded mode: VDP1 and VDP2 drawing move to dedicated worker threads fed
+// through lock-free queues (corethreads.c, from the core patches), and the
+// core gets yinit.usethreads/numthreads for its own helpers. --thread-cpus
+// pins the VDP1, VDP2 and SCSP threads; the launcher's isolate_cpu leaves
+// threads pinned like that alone and keeps the emulation thread to itself.
+static int  g_threads = 0;   // Core worker threads, 0 = everything on the emulation thread
+static int  g_thread_cpus[CORE_THREAD_COUNT] = {-1, -1, -1};
+static bool g_stats   = false;
+static std::atomic<unsigned> g_frames_presented(0);
+
+// Frame pacing: FIFO blocks in present() on vblank, anything else (or a panel
+// rate that doesn't match the emulated one) is paced here with absolute sleeps
+extern uint32_t g_display_refresh_mhz; // Window_kmsdrm.cpp
+
+// Display mode and scanout size, consumed by Window_kmsdrm.cpp
+extern uint32_t g_display_index;
+extern uint32_t g_mode_width, g_mode_height, g_mode_refresh;
+extern uint32_t g_scanout_width, g_scanout_height;
+
+// Per-game VkPipelineCache file, consumed by PipelineCache_kmsdrm.cpp
+extern std::string g_pipeline_cache_path;
+static bool g_pipeline_cache = true;
+#define PIPELINE_CACHE_DIR "/mnt/games/data/.cache/vulkan/"
+static VkPresentModeKHR g_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+
+// Save states, SaveState_kmsdrm.cpp
+#define STATE_DIR   "/mnt/games/data/states"
+#define STATE_SLOTS 10
+void savestate_init(const char *dir, const char *disc_path);
+bool savestate_save(int slot);
+bool savestate_load(int slot);
+bool savestate_quick_save();
+bool savestate_quick_load();
+void savestate_shutdown();
+
+// Disc image caching, CdCache_kmsdrm.cpp
+extern size_t g_cd_cache_bytes;
+static bool g_cd_preload = false;
+std::string cd_preload(const char *path);
+void cd_preload_release();
+void cd_cache_shutdown();
+
+// Performance HUD, Hud_kmsdrm.cpp
+static bool g_hud = false;
+static char g_hud_log[512] = "\0";
+int hud_init(bool visible, const char *csv_path, bool stats);
+void hud_toggle();
+void hud_frame(double now, unsigned long emulated_frames, unsigned presented_frames,
+               double emulated_hz);
+void hud_shutdown();
+
+// Accuracy/speed trade-offs the core only takes at init. Named presets so a
+// profile can pick one per game, --sh2-cache/--scsp-sync override either value.
+struct EmulationPreset {
+    const char *name;
+    int use_sh2_cache;             // Emulate the SH2 instruction/data cache
+    int scsp_sync_count_per_frame; // SCSP/68K catch-ups with the SH2s per frame
+};
+static const EmulationPreset g_presets[] = {
+    {"speed",    0, 16},
+    {"balanced", 0, 64},
+    {"accurate", 1, 128},
+};
+#define PRESET_COUNT (int)(sizeof(g_presets) / sizeof(g_presets[0]))
+static int g_preset = 1;
+static int g_sh2_cache = -1; // -1 = from the preset
+static int g_scsp_sync = -1;
+
+// Headless benchmark: no display, sound or input, just N frames as fast as
+// the core can go, optionally once per preset
+static int g_bench_frames = 0;
+static bool g_bench_all = false;
+#define BENCH_BACKUP_PATH "/dev/shm/yabause-bench-backup.bin"
+
+// Frameskip: off, the core's own auto skipping all the time, or adaptive,
+// which only lets the core skip VDP rendering while emulation is behind real
+// time by more than skip_lag_high frames, until it is back within skip_lag_low
+enum FrameskipMode { FRAMESKIP_OFF, FRAMESKIP_AUTO, FRAMESKIP_ADAPTIVE };
+static FrameskipMode g_frameskip = FRAMESKIP_ADAPTIVE;
+static double g_skip_lag_low  = 0.0;
+static double g_skip_lag_high = 2.0;
+#define FRAMESKIP_MAX_DEBT 15.0 // Frames, so a loading stall isn't paid back for seconds
+
+struct FrameskipController {
+    double last = 0.0;
+    double behind = 0.0; // Frames emulation is behind real time
+    bool skipping = false;
+
+    void update(double now, double hz) {
+        if (last > 0.0)
+            behind += (now - last) * hz - 1.0;
+        last = now;
+
+        // Running ahead is the pacer's business, not ours
+        behind = std::min(std::max(behind, 0.0), FRAMESKIP_MAX_DEBT);
+
+        if (!skipping && behind > g_skip_lag_high) {
+            EnableAutoFrameSkip();
+            skipping = true;
+        } else if (skipping && behind <= g_skip_lag_low) {
+            DisableAutoFrameSkip();
+            skipping = false;
+        }
+    }
+};
+
 static char biospath[512] = "\0";
 static char cdpath[512]   = "\0";
 static char buppath[512]  = "/mnt/games/data/saves/stn_backup.bin";
@@ -138,7 +259,9 @@ extern "C" void YuiErrorMsg(const char *string) {
 }
 
 extern "C" void YuiSwapBuffers(void) {
-    VIDVulkan::getInstance()->present();
+    if (!g_bench_frames)
+        VIDVulkan::getInstance()->present();
+    g_frames_presented.fetch_add(1, std::memory_order_relaxed);
     return;
 }
 
@@ -154,6 +277,26 @@ extern "C" const char *YuiGetShaderCachePath(void) {
     return "/mnt/games/data/.cache/";
 }
 
+// Pad buttons pressed while Guide is held are hotkeys, not game input. The
+// core's joystick polling is linked through this (-Wl,--wrap) and sees them
+// released until they are let go, the port reads the pad with the real call.
+static uint32_t g_held_back = 0; // Bit per button, main thread only
+
+extern "C" Uint8 __real_SDL_JoystickGetButton(SDL_Joystick *joystick, int button);
+extern "C" Uint8 __wrap_SDL_JoystickGetButton(SDL_Joystick *joystick, int button) {
+    if (button >= 0 && button < 32 && (g_held_back >> button & 1))
+        return 0;
+    return __real_SDL_JoystickGetButton(joystick, button);
+}
+
+static void hold_back_buttons(SDL_Joystick *joystick, bool guide) {
+    int count = std::min(SDL_JoystickNumButtons(joystick), 32);
+    uint32_t pressed = 0;
+    for (int b = 0; b < count; b++)
+        pressed |= (uint32_t)(__real_SDL_JoystickGetButton(joystick, b) != 0) << b;
+    g_held_back = guide ? pressed : g_held_back & pressed;
+}
+
 static void signal_handler(int sig) {
     (void)sig;
     g_running = 0;
@@ -174,37 +317,118 @@ void print_usage(const char *prog) {
            "Options:\n"
            "  -b, --bios=PATH     Saturn BIOS file\n"
            "  -i, --iso=PATH      Disc image (ISO/CUE/CHD)\n"
+           "  -t, --threads=N     Draw VDP1/VDP2 on their own threads, N core helper threads\n"
+           "      --thread-cpus=VDP1,VDP2,SCSP  Pin those threads, -1 leaves one where it is\n"
+           "      --stats         Print speed, CPU per thread and audio sync every 5 seconds\n"
+           "      --present=MODE  fifo (default, vsync) or mailbox\n"
+           "      --display=N     VK_KHR_display display index\n"
+           "      --mode=WxH[@HZ] Display mode, default is the panel's native size\n"
+           "      --scanout=WxH   Render at WxH and let the display plane scale it\n"
+           "      --no-pipeline-cache  Don't load or save this game's pipeline cache\n"
+           "      --frameskip=MODE    adaptive (default), auto or off\n"
+           "      --frameskip-lag=LOW,HIGH  adaptive thresholds in frames (0,2)\n"
+           "      --cd-cache=MB   Decompressed CHD hunk cache, 0 disables (16)\n"
+           "      --cd-preload    Copy the disc image to /dev/shm if it fits\n"
+           "      --hud           Start with the performance HUD shown (Guide+Select)\n"
+           "      --hud-log=PATH  Append HUD samples to a CSV file\n"
+           "      --audio-buffer=N  Audio device buffer in frames (512)\n"
+           "      --preset=NAME   speed, balanced (default) or accurate\n"
+           "      --sh2-cache=0|1 Override the preset's SH2 cache emulation\n"
+           "      --scsp-sync=N   Override the preset's SCSP syncs per frame\n"
+           "      --bench=N       Run N frames headless and report frames/sec;\n"
+           "                      with --preset=all, once per preset\n"
            "  -h, --help          Show this help\n",
            prog);
 }
 
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The swapchain is created by the core, which picks MAILBOX whenever the driver
+// offers it. Interposing the present mode query lets the port choose instead;
+// it only narrows the list when the requested mode is actually supported.
+extern "C" VKAPI_ATTR VkResult VKAPI_CALL vkGetPhysicalDeviceSurfacePresentModesKHR(
+    VkPhysicalDevice gpu, VkSurfaceKHR surface, uint32_t *count, VkPresentModeKHR *modes) {
+    static PFN_vkGetPhysicalDeviceSurfacePresentModesKHR real =
+        (PFN_vkGetPhysicalDeviceSurfacePresentModesKHR)dlsym(RTLD_NEXT,
+            "vkGetPhysicalDeviceSurfacePresentModesKHR");
+    if (!real)
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    uint32_t n = 0;
+    real(gpu, surface, &n, nullptr);
+    std::vector<VkPresentModeKHR> all(n);
+    real(gpu, surface, &n, all.data());
+    if (std::find(all.begin(), all.end(), g_present_mode) == all.end())
+        return real(gpu, surface, count, modes);
+
+    if (!modes) {
+        *count = 1;
+        return VK_SUCCESS;
+    }
+    if (*count < 1)
+        return VK_INCOMPLETE;
+    modes[0] = g_present_mode;
+    *count = 1;
+    return VK_SUCCESS;
+}
+
+// Sleeps until the next frame deadline. Falling more than a frame behind
+// resyncs instead of racing to catch up.
+static void pace_frame(double &deadline, double period) {
+    double now = now_seconds();
+    deadline += period;
+    if (deadline < now - period) {
+        deadline = now;
+        return;
+    }
+    if (deadline <= now)
+        return;
+
+    struct timespec ts;
+    ts.tv_sec = (time_t)deadline;
+    ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR && g_running)
+        ;
+}
+
 int yabauseinit() {
     yabauseinit_struct yinit = {};
 
+    const EmulationPreset &preset = g_presets[g_preset];
+    bool bench = g_bench_frames > 0;
+
     yinit.m68kcoretype  = M68KCORE_C68K;
     yinit.sh2coretype   = 3; // DYNRAEC_DEVMIYAX
-    yinit.vidcoretype   = VIDCORE_VULKAN;
-    yinit.sndcoretype   = SNDCORE_SDL;
-    yinit.percoretype   = PERCORE_SDLJOY;
+    yinit.vidcoretype   = bench ? VIDCORE_DUMMY : VIDCORE_VULKAN;
+    yinit.sndcoretype   = bench ? SNDCORE_DUMMY : SNDKmsdrm.id;
+    yinit.percoretype   = bench ? PERCORE_DUMMY : PERCORE_SDLJOY;
     yinit.cdcoretype    = CDCORE_ISO;
     yinit.carttype      = CART_DRAM32MBIT;
     yinit.regionid      = REGION_AUTODETECT;
     yinit.biospath      = biospath;
     yinit.cdpath        = cdpath;
-    yinit.buppath       = buppath;
+    yinit.buppath       = bench ? BENCH_BACKUP_PATH : buppath; // Keep real saves out of it
     yinit.mpegpath      = NULL;
     yinit.cartpath      = cartpath;
     yinit.videoformattype = VIDEOFORMATTYPE_NTSC;
-    yinit.osdcoretype   = OSDCORE_DUMMY;
+    yinit.osdcoretype   = bench ? OSDCORE_DUMMY : hud_init(g_hud, g_hud_log, g_stats);
     yinit.skip_load     = 0;
-    yinit.usethreads    = 0;
+    yinit.usethreads    = g_threads > 0;
+    yinit.numthreads    = g_threads;
     yinit.polygon_generation_mode = PERSPECTIVE_CORRECTION;
-    yinit.frameskip     = 1;
+    yinit.frameskip     = !bench && g_frameskip == FRAMESKIP_AUTO;
     yinit.use_new_scsp  = 1;
-    yinit.scsp_sync_count_per_frame = 64;
+    yinit.scsp_sync_count_per_frame = g_scsp_sync > 0 ? g_scsp_sync : preset.scsp_sync_count_per_frame;
     yinit.scsp_main_mode = 0;
     yinit.extend_backup = 1;
-    yinit.use_sh2_cache = 0;
+    yinit.use_sh2_cache = g_sh2_cache >= 0 ? g_sh2_cache : preset.use_sh2_cache;
+
+    fprintf(stderr, "YabaSanshiro: %s preset, SH2 cache %s, %d SCSP syncs per frame\n",
+            preset.name, yinit.use_sh2_cache ? "on" : "off", yinit.scsp_sync_count_per_frame);
 
     if (YabauseInit(&yinit) != 0) {
         fprintf(stderr, "YabauseInit failed\n");
@@ -216,6 +440,65 @@ int yabauseinit() {
     return 0;
 }
 
+// One line per preset on stdout, the second half excludes BIOS boot and
+// loading. Frame times are over the second half too, the launcher's
+// regression benchmark reads them from this line.
+static int run_benchmark() {
+    int first = g_bench_all ? 0 : g_preset;
+    int last = g_bench_all ? PRESET_COUNT - 1 : g_preset;
+    std::vector<double> frame_ms;
+    frame_ms.reserve(g_bench_frames - g_bench_frames / 2 + 1);
+
+    for (int p = first; p <= last && g_running; p++) {
+        g_preset = p;
+        if (yabauseinit() != 0)
+            return 1;
+
+        int half = g_bench_frames / 2;
+        double start = now_seconds(), half_time = start, last_time = start;
+        int frames = 0;
+        frame_ms.clear();
+        while (frames < g_bench_frames && g_running) {
+            if (PERCore && PERCore->HandleEvents() == -1)
+                break;
+            double now = now_seconds();
+            if (++frames == half)
+                half_time = now;
+            else if (frames > half)
+                frame_ms.push_back((now - last_time) * 1000.0);
+            last_time = now;
+        }
+        double end = now_seconds();
+
+        double fps = frames / (end - start);
+        double steady = frames > half ? (frames - half) / (end - half_time) : fps;
+        double avg_ms = 0.0, p99_ms = 0.0;
+        if (!frame_ms.empty()) {
+            for (double ms : frame_ms)
+                avg_ms += ms;
+            avg_ms /= frame_ms.size();
+            size_t rank = std::min(frame_ms.size() - 1, (size_t)(frame_ms.size() * 0.99));
+            std::nth_element(frame_ms.begin(), frame_ms.begin() + rank, frame_ms.end());
+            p99_ms = frame_ms[rank];
+        }
+        printf("bench: preset=%s sh2_cache=%d scsp_sync=%d threads=%d frames=%d "
+               "seconds=%.2f fps=%.1f steady_fps=%.1f frame_ms_avg=%.2f frame_ms_p99=%.2f\n",
+               g_presets[p].name,
+               g_sh2_cache >= 0 ? g_sh2_cache : g_presets[p].use_sh2_cache,
+               g_scsp_sync > 0 ? g_scsp_sync : g_presets[p].scsp_sync_count_per_frame,
+               g_threads, frames, end - start, fps, steady, avg_ms, p99_ms);
+        fflush(stdout);
+
+        YabauseDeInit();
+        LogStop();
+    }
+
+    unlink(BENCH_BACKUP_PATH);
+    cd_cache_shutdown();
+    cd_preload_release();
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     signal(SIGTERM, signal_handler);
     signal(SIGINT,  signal_handler);
@@ -242,8 +525,123 @@ int main(int argc, char *argv[]) {
         else if (strstr(argv[i], "--iso=") == argv[i]) {
             strncpy(cdpath, argv[i] + 6, sizeof(cdpath) - 1);
         }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            g_threads = atoi(argv[++i]);
+        }
+        else if (strstr(argv[i], "--threads=") == argv[i]) {
+            g_threads = atoi(argv[i] + 10);
+        }
+        else if (strstr(argv[i], "--thread-cpus=") == argv[i]) {
+            int *c = g_thread_cpus;
+            if (sscanf(argv[i] + 14, "%d,%d,%d", &c[0], &c[1], &c[2]) != CORE_THREAD_COUNT)
+                c[0] = c[1] = c[2] = -1;
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            g_stats = true;
+        }
+        else if (strcmp(argv[i], "--present=mailbox") == 0) {
+            g_present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+        else if (strcmp(argv[i], "--present=fifo") == 0) {
+            g_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        }
+        else if (strcmp(argv[i], "--no-pipeline-cache") == 0) {
+            g_pipeline_cache = false;
+        }
+        else if (strstr(argv[i], "--display=") == argv[i]) {
+            g_display_index = (uint32_t)atoi(argv[i] + 10);
+        }
+        else if (strstr(argv[i], "--mode=") == argv[i]) {
+            if (sscanf(argv[i] + 7, "%ux%u@%u", &g_mode_width, &g_mode_height, &g_mode_refresh) < 2)
+                g_mode_width = g_mode_height = g_mode_refresh = 0;
+        }
+        else if (strstr(argv[i], "--scanout=") == argv[i]) {
+            if (sscanf(argv[i] + 10, "%ux%u", &g_scanout_width, &g_scanout_height) != 2)
+                g_scanout_width = g_scanout_height = 0;
+        }
+        else if (strcmp(argv[i], "--frameskip=off") == 0) {
+            g_frameskip = FRAMESKIP_OFF;
+        }
+        else if (strcmp(argv[i], "--frameskip=auto") == 0) {
+            g_frameskip = FRAMESKIP_AUTO;
+        }
+        else if (strcmp(argv[i], "--frameskip=adaptive") == 0) {
+            g_frameskip = FRAMESKIP_ADAPTIVE;
+        }
+        else if (strstr(argv[i], "--cd-cache=") == argv[i]) {
+            g_cd_cache_bytes = (size_t)atoi(argv[i] + 11) << 20;
+        }
+        else if (strcmp(argv[i], "--cd-preload") == 0) {
+            g_cd_preload = true;
+        }
+        else if (strstr(argv[i], "--preset=") == argv[i]) {
+            const char *name = argv[i] + 9;
+            g_bench_all = strcmp(name, "all") == 0;
+            for (int p = 0; p < PRESET_COUNT; p++) {
+                if (strcmp(name, g_presets[p].name) == 0)
+                    g_preset = p;
+            }
+        }
+        else if (strstr(argv[i], "--sh2-cache=") == argv[i]) {
+            g_sh2_cache = atoi(argv[i] + 12) ? 1 : 0;
+        }
+        else if (strstr(argv[i], "--scsp-sync=") == argv[i]) {
+            g_scsp_sync = atoi(argv[i] + 12);
+        }
+        else if (strstr(argv[i], "--bench=") == argv[i]) {
+            g_bench_frames = atoi(argv[i] + 8);
+        }
+        else if (strcmp(argv[i], "--hud") == 0) {
+            g_hud = true;
+        }
+        else if (strstr(argv[i], "--hud-log=") == argv[i]) {
+            strncpy(g_hud_log, argv[i] + 10, sizeof(g_hud_log) - 1);
+        }
+        else if (strstr(argv[i], "--audio-buffer=") == argv[i]) {
+            g_audio_buffer_frames = atoi(argv[i] + 15);
+        }
+        else if (strstr(argv[i], "--frameskip-lag=") == argv[i]) {
+            double low, high;
+            if (sscanf(argv[i] + 16, "%lf,%lf", &low, &high) == 2 && low >= 0.0 && high > low) {
+                g_skip_lag_low = low;
+                g_skip_lag_high = high;
+            }
+        }
+    }
+
+    // The copy keeps the image's file name, so everything keyed on it below
+    // stays the same
+    if (g_cd_preload && cdpath[0]) {
+        std::string path = cd_preload(cdpath);
+        snprintf(cdpath, sizeof(cdpath), "%s", path.c_str());
+    }
+
+    // Keyed on the disc image name so every game keeps its own pipelines
+    if (g_pipeline_cache && cdpath[0]) {
+        const char *name = strrchr(cdpath, '/');
+        g_pipeline_cache_path = std::string(PIPELINE_CACHE_DIR) + (name ? name + 1 : cdpath) + ".pcache";
     }
 
+    for (int t = 0; t < CORE_THREAD_COUNT; t++)
+        CoreThreadSetCpu(t, g_thread_cpus[t]);
+
+    // Only count while the HUD asks for it, see hud_init()
+#ifdef DYNAREC_DEVMIYAX
+    PerfWrapSH2(&SH2Dyn);
+#endif
+#ifdef HAVE_C68K
+    PerfWrapM68K(&M68KC68K);
+#endif
+
+    if (g_bench_frames > 0)
+        return run_benchmark();
+
+    CoreThreadsWrapVideo(&CVIDVulkan);
+    if (g_threads > 0 && CoreThreadsStart() == 0)
+        fprintf(stderr, "YabaSanshiro: threaded mode, VDP1/VDP2 on workers (CPUs %d/%d, SCSP %d), "
+                        "%d core helper thread(s)\n",
+                g_thread_cpus[0], g_thread_cpus[1], g_thread_cpus[2], g_threads);
+
     if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER) < 0) {
         fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
         return 1;
@@ -291,7 +689,22 @@ int main(int argc, char *argv[]) {
     }
 
     SDL_Joystick *joy0 = SDL_JoystickOpen(0);
-    int prev_l3 = 0, prev_r3 = 0;
+    int prev_l3 = 0, prev_r3 = 0, prev_l1 = 0, prev_r1 = 0, prev_left = 0, prev_right = 0;
+    int prev_select = 0;
+    int state_slot = 0;
+    savestate_init(STATE_DIR, cdpath);
+
+    unsigned emulated_frames = 0;
+
+    double emulated_hz = yabsys.IsPal ? 50.0 : 60.0;
+    double display_hz = g_display_refresh_mhz ? g_display_refresh_mhz / 1000.0 : 60.0;
+    bool sleep_pacing = g_present_mode != VK_PRESENT_MODE_FIFO_KHR ||
+                        std::fabs(display_hz - emulated_hz) > 0.5;
+    double frame_deadline = now_seconds();
+    FrameskipController frameskip;
+    fprintf(stderr, "YabaSanshiro: %s present, %.2f Hz panel, %s pacing\n",
+            g_present_mode == VK_PRESENT_MODE_FIFO_KHR ? "FIFO" : "MAILBOX",
+            display_hz, sleep_pacing ? "sleep" : "vblank");
 
     SDL_Event event;
     while (g_running) {
@@ -301,29 +714,62 @@ int main(int argc, char *argv[]) {
         }
 
         if (joy0) {
-            int guide = SDL_JoystickGetButton(joy0, 10);
-            int l3    = SDL_JoystickGetButton(joy0, 11);
-            int r3    = SDL_JoystickGetButton(joy0, 12);
-
-            if (guide && r3 && !prev_r3) {
-                YabSaveStateSlot("/mnt/games/data/states", 0);
-                fprintf(stderr, "YabaSanshiro: state saved\n");
-            }
-            if (guide && l3 && !prev_l3) {
-                YabLoadStateSlot("/mnt/games/data/states", 0);
-                fprintf(stderr, "YabaSanshiro: state loaded\n");
+            int guide = __real_SDL_JoystickGetButton(joy0, 10);
+            int select = __real_SDL_JoystickGetButton(joy0, 8);
+            int l1    = __real_SDL_JoystickGetButton(joy0, 4);
+            int r1    = __real_SDL_JoystickGetButton(joy0, 5);
+            int l3    = __real_SDL_JoystickGetButton(joy0, 11);
+            int r3    = __real_SDL_JoystickGetButton(joy0, 12);
+            int left  = __real_SDL_JoystickGetButton(joy0, 15);
+            int right = __real_SDL_JoystickGetButton(joy0, 16);
+
+            if (guide && ((left && !prev_left) || (right && !prev_right))) {
+                state_slot = (state_slot + (right ? 1 : STATE_SLOTS - 1)) % STATE_SLOTS;
+                fprintf(stderr, "YabaSanshiro: state slot %d\n", state_slot);
             }
+            if (guide && r3 && !prev_r3 && savestate_save(state_slot))
+                fprintf(stderr, "YabaSanshiro: state saved to slot %d\n", state_slot);
+            if (guide && l3 && !prev_l3 && savestate_load(state_slot))
+                fprintf(stderr, "YabaSanshiro: state loaded from slot %d\n", state_slot);
+            if (guide && r1 && !prev_r1 && savestate_quick_save())
+                fprintf(stderr, "YabaSanshiro: quick state saved\n");
+            if (guide && l1 && !prev_l1 && savestate_quick_load())
+                fprintf(stderr, "YabaSanshiro: quick state loaded\n");
+            if (guide && select && !prev_select)
+                hud_toggle();
+            prev_select = select;
+            prev_l1 = l1;
+            prev_r1 = r1;
             prev_l3 = l3;
             prev_r3 = r3;
+            prev_left = left;
+            prev_right = right;
+            hold_back_buttons(joy0, guide);
         }
 
+        // Runs one emulated frame
         if (PERCore && PERCore->HandleEvents() == -1)
             g_running = 0;
+        emulated_frames++;
+
+        if (sleep_pacing)
+            pace_frame(frame_deadline, 1.0 / emulated_hz);
+
+        if (g_frameskip == FRAMESKIP_ADAPTIVE)
+            frameskip.update(now_seconds(), emulated_hz);
+
+        hud_frame(now_seconds(), emulated_frames, g_frames_presented.load(std::memory_order_relaxed),
+                  emulated_hz);
     }
 
     if (joy0) SDL_JoystickClose(joy0);
 
+    savestate_shutdown();
+    hud_shutdown();
     YabauseDeInit();
+    CoreThreadsStop();
+    cd_cache_shutdown();
+    cd_preload_release();
     LogStop();
 
     SDL_Quit();